@@ -1,6 +1,7 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -15,8 +16,44 @@ using namespace glm;
 
 #include <common/shader.hpp>
 
-int main( void )
+#include "../scenegen/scenegen.hpp"
+#include "../hw2/softrast.hpp"
+
+// Must come after every GL/GLFW header: redirects GL calls through the capture layer
+#include "../hw2/gltrace.hpp"
+
+// Copies a frame of the CPU backend to the window, without blending it over what is there
+void presentSoftFrame(softrast::Rasterizer& rasterizer) {
+    const auto& pixels = rasterizer.flush();
+    glUseProgram(0);
+    glDisable(GL_BLEND);
+    glWindowPos2i(0, 0);
+    glDrawPixels(rasterizer.getWidth(), rasterizer.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glEnable(GL_BLEND);
+}
+
+int main(int argc, char* argv[])
 {
+    // --scene <spec> replaces the two triangles with a generated scene, see scenegen.hpp
+    scenegen::Options options;
+    if (!scenegen::parseOptions(argc, argv, options)) {
+        return -1;
+    }
+    // --capture <file>  : record the GL calls of the session into a trace for hw2/gltrace_replay
+    // --backend gl|soft : render through OpenGL (default) or the CPU rasterizer of hw2
+    // --threads <n>     : threads rasterizing on the CPU, the main one included, 0 = one per core
+    bool softBackend = false;
+    unsigned softThreads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            gltrace::begin(argv[++i]);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            softBackend = strcmp(argv[++i], "soft") == 0;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            softThreads = unsigned(atoi(argv[++i]));
+        }
+    }
+
     // Initialise GLFW
     if( !glfwInit() )
     {
@@ -51,19 +88,40 @@ int main( void )
     // Ensure we can capture the escape key being pressed below
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
+    // Do not let vsync cap the measured frame times
+    if (options.benchFrames > 0) {
+        glfwSwapInterval(0);
+    }
+
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_BLEND);
 
     // Dark blue background
     glClearColor(0.0f, 0.0f, 1.4f, 0.0f);
 
+    // The CPU backend gets the same state: no depth test, no culling, alpha blending
+    softrast::Rasterizer* softRasterizer = nullptr;
+    if (softBackend) {
+        softRasterizer = new softrast::Rasterizer(1024, 768, softThreads);
+        softRasterizer->depthTest = false;
+        softRasterizer->cullBackFaces = false;
+        softRasterizer->blend = true;
+    }
+    // What RedTriangleSimpleFragmentShader and GreenTriangleSimpleFragmentShader output
+    const glm::vec4 red(1.f, 0.f, 0.f, 0.35f);
+    const glm::vec4 green(0.f, 1.f, 0.f, 0.5f);
+
     // Create and compile our GLSL program from the shaders
     GLuint redProgramID = LoadShaders( "SimpleVertexShader.vertexshader", "RedTriangleSimpleFragmentShader.fragmentshader" );
     GLuint greenProgramID = LoadShaders( "SimpleVertexShader.vertexshader", "GreenTriangleSimpleFragmentShader.fragmentshader" );
+    // The scene draws every material with this one, its colour is set per batch
+    GLuint sceneProgramID = LoadShaders( "SimpleVertexShader.vertexshader", "MaterialFragmentShader.fragmentshader" );
 
     // Get a handle for our buffers
     GLuint red_vertexPosition_modelspaceID = glGetAttribLocation(redProgramID, "vertexPosition_modelspace");
     GLuint green_vertexPosition_modelspaceID = glGetAttribLocation(greenProgramID, "vertexPosition_modelspace");
+    GLuint scene_vertexPosition_modelspaceID = glGetAttribLocation(sceneProgramID, "vertexPosition_modelspace");
+    GLuint MaterialColorID = glGetUniformLocation(sceneProgramID, "materialColor");
 
     static const GLfloat g_vertex_buffer_data[] = {
             -0.9f, -0.9f, 0.0f,
@@ -80,59 +138,155 @@ int main( void )
     glGenBuffers(1, &vertexbuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+    std::vector<glm::vec3> triangleVertices;
+    for (size_t i = 0; i < sizeof(g_vertex_buffer_data) / sizeof(GLfloat); i += 3) {
+        triangleVertices.push_back(glm::vec3(g_vertex_buffer_data[i], g_vertex_buffer_data[i + 1], g_vertex_buffer_data[i + 2]));
+    }
+
+    // The scene is squeezed into clip space since this demo has no camera
+    scenegen::Scene scene;
+    std::vector<scenegen::Batch> sceneBatches, projectileBatches;
+    std::vector<glm::vec3> scenePositions, sceneColors, projectilePositions, projectileColors;
+    std::vector<glm::vec4> materialColors;
+    GLuint scenebuffer = 0;
+    GLuint projectilebuffer = 0;
+    float sceneScale = 1.f;
+    if (options.hasScene) {
+        scene = scenegen::generate(options.params);
+        sceneScale = 1.f / (scene.params.extent + scene.params.radius);
+        // Half transparent like the green triangle, so overlapping spheres stay readable
+        for (const auto& color : scene.materialColors) {
+            materialColors.push_back(glm::vec4(color, 0.5f));
+        }
+        sceneBatches = scenegen::flatten(scene, scene.sphere, scene.spheres, sceneScale, scenePositions, sceneColors);
+        glGenBuffers(1, &scenebuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, scenebuffer);
+        glBufferData(GL_ARRAY_BUFFER, scenePositions.size() * sizeof(glm::vec3), scenePositions.data(), GL_STATIC_DRAW);
+        // Projectiles move every frame but their count does not, their buffer is rewritten in place
+        scenegen::flatten(scene, scene.projectile, scene.projectiles, sceneScale, projectilePositions, projectileColors,
+                          projectileBatches);
+        glGenBuffers(1, &projectilebuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, projectilebuffer);
+        glBufferData(GL_ARRAY_BUFFER, projectilePositions.size() * sizeof(glm::vec3), projectilePositions.data(), GL_STREAM_DRAW);
+    }
+    scenegen::FrameTimer frameTimer(options.benchFrames);
+    double lastTime = glfwGetTime();
 
     do{
 
         // Clear the screen
         glClear( GL_COLOR_BUFFER_BIT );
 
-        // Use our shader
-
-        // 1rst attribute buffer : vertices
-        glEnableVertexAttribArray(red_vertexPosition_modelspaceID);
-        glEnableVertexAttribArray(green_vertexPosition_modelspaceID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-        glVertexAttribPointer(
-                red_vertexPosition_modelspaceID, // The attribute we want to configure
-                3,                  // size
-                GL_FLOAT,           // type
-                GL_FALSE,           // normalized?
-                0,                  // stride
-                (void*)0            // array buffer offset
-        );
-        glVertexAttribPointer(
-                green_vertexPosition_modelspaceID, // The attribute we want to configure
-                3,                  // size
-                GL_FLOAT,           // type
-                GL_FALSE,           // normalized?
-                0,                  // stride
-                (void*)0            // array buffer offset
-        );
-
-        // Draw the triangle !
-
-        glUseProgram(redProgramID);
-        glDrawArrays(GL_TRIANGLES, 0, 3); // 3 indices starting at 0 -> 1 triangle
-        glUseProgram(greenProgramID);
-        glDrawArrays(GL_TRIANGLES, 3, 3); // 3 indices starting at 0 -> 1 triangle
-
-        glDisableVertexAttribArray(red_vertexPosition_modelspaceID);
-        glDisableVertexAttribArray(green_vertexPosition_modelspaceID);
+        if (options.hasScene) {
+            const double now = glfwGetTime();
+            scenegen::advance(scene, float(now - lastTime));
+            lastTime = now;
+            scenegen::flatten(scene, scene.projectile, scene.projectiles, sceneScale, projectilePositions, projectileColors,
+                              projectileBatches);
+        }
+
+        if (softRasterizer) {
+            softRasterizer->clear(glm::vec4(0.0f, 0.0f, 1.4f, 0.0f));
+            if (!options.hasScene) {
+                softRasterizer->drawColored(triangleVertices, 0, 3, glm::mat4(1.f), red);
+                softRasterizer->drawColored(triangleVertices, 3, 3, glm::mat4(1.f), green);
+            } else {
+                for (const auto& batch : sceneBatches) {
+                    softRasterizer->drawColored(scenePositions, batch.first, batch.count, glm::mat4(1.f),
+                                                materialColors[batch.material]);
+                }
+                for (const auto& batch : projectileBatches) {
+                    softRasterizer->drawColored(projectilePositions, batch.first, batch.count, glm::mat4(1.f),
+                                                materialColors[batch.material]);
+                }
+            }
+            presentSoftFrame(*softRasterizer);
+        } else {
+            // Use our shader
+
+            if (!options.hasScene) {
+                // 1rst attribute buffer : vertices
+                glEnableVertexAttribArray(red_vertexPosition_modelspaceID);
+                glEnableVertexAttribArray(green_vertexPosition_modelspaceID);
+                glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+                glVertexAttribPointer(
+                        red_vertexPosition_modelspaceID, // The attribute we want to configure
+                        3,                  // size
+                        GL_FLOAT,           // type
+                        GL_FALSE,           // normalized?
+                        0,                  // stride
+                        (void*)0            // array buffer offset
+                );
+                glVertexAttribPointer(
+                        green_vertexPosition_modelspaceID, // The attribute we want to configure
+                        3,                  // size
+                        GL_FLOAT,           // type
+                        GL_FALSE,           // normalized?
+                        0,                  // stride
+                        (void*)0            // array buffer offset
+                );
+
+                // Draw the triangle !
+                glUseProgram(redProgramID);
+                glDrawArrays(GL_TRIANGLES, 0, 3); // 3 indices starting at 0 -> 1 triangle
+                glUseProgram(greenProgramID);
+                glDrawArrays(GL_TRIANGLES, 3, 3); // 3 indices starting at 0 -> 1 triangle
+
+                glDisableVertexAttribArray(red_vertexPosition_modelspaceID);
+                glDisableVertexAttribArray(green_vertexPosition_modelspaceID);
+            } else {
+                // Only the scene program's attribute is enabled, and it always points at the buffer being drawn
+                glUseProgram(sceneProgramID);
+                glEnableVertexAttribArray(scene_vertexPosition_modelspaceID);
+                glBindBuffer(GL_ARRAY_BUFFER, scenebuffer);
+                glVertexAttribPointer(scene_vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+                for (const auto& batch : sceneBatches) {
+                    glUniform4fv(MaterialColorID, 1, &materialColors[batch.material][0]);
+                    glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
+                }
+
+                glBindBuffer(GL_ARRAY_BUFFER, projectilebuffer);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, projectilePositions.size() * sizeof(glm::vec3), projectilePositions.data());
+                glVertexAttribPointer(scene_vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+                for (const auto& batch : projectileBatches) {
+                    glUniform4fv(MaterialColorID, 1, &materialColors[batch.material][0]);
+                    glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
+                }
+
+                glDisableVertexAttribArray(scene_vertexPosition_modelspaceID);
+            }
+        }
 
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
 
+        if (frameTimer.tick(glfwGetTime())) {
+            break;
+        }
+
     } // Check if the ESC key was pressed or the window was closed
     while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
            glfwWindowShouldClose(window) == 0 );
 
+    if (options.benchFrames > 0) {
+        frameTimer.print("hw1");
+        if (!options.benchCsv.empty()) {
+            frameTimer.writeCsv(options.benchCsv, "hw1", options.params);
+        }
+    }
+
 
     // Cleanup VBO
     glDeleteBuffers(1, &vertexbuffer);
+    glDeleteBuffers(1, &scenebuffer);
+    glDeleteBuffers(1, &projectilebuffer);
     glDeleteProgram(redProgramID);
     glDeleteProgram(greenProgramID);
+    glDeleteProgram(sceneProgramID);
 
+    gltrace::end();
+    delete softRasterizer;
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
 
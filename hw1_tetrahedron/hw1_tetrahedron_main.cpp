@@ -1,6 +1,7 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -16,8 +17,25 @@ using namespace glm;
 
 #include <common/shader.hpp>
 
-int main( void )
+#include "../scenegen/scenegen.hpp"
+
+// Must come after every GL/GLFW header: redirects GL calls through the capture layer
+#include "../hw2/gltrace.hpp"
+
+int main(int argc, char* argv[])
 {
+	// --scene <spec> replaces the pyramid with a generated scene, see scenegen.hpp
+	scenegen::Options options;
+	if (!scenegen::parseOptions(argc, argv, options)) {
+		return -1;
+	}
+	// --capture <file> records the GL calls of the session into a trace for hw2/gltrace_replay
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			gltrace::begin(argv[++i]);
+		}
+	}
+
 	// Initialise GLFW
 	if( !glfwInit() )
 	{
@@ -52,6 +70,11 @@ int main( void )
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
+	// Do not let vsync cap the measured frame times
+	if (options.benchFrames > 0) {
+		glfwSwapInterval(0);
+	}
+
 	// Dark blue background
 	glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
 
@@ -152,6 +175,37 @@ int main( void )
 	glGenBuffers(1, &colorbuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(g_color_buffer_data), g_color_buffer_data, GL_STATIC_DRAW);
+
+	// The scene is scaled to fit inside the orbit of the camera
+	scenegen::Scene scene;
+	std::vector<scenegen::Batch> sceneBatches, projectileBatches;
+	std::vector<glm::vec3> scenePositions, sceneColors, projectilePositions, projectileColors;
+	GLuint scenebuffer = 0, scenecolorbuffer = 0;
+	GLuint projectilebuffer = 0, projectilecolorbuffer = 0;
+	float sceneScale = 1.f;
+	if (options.hasScene) {
+		scene = scenegen::generate(options.params);
+		sceneScale = 5.f / (scene.params.extent + scene.params.radius);
+		sceneBatches = scenegen::flatten(scene, scene.sphere, scene.spheres, sceneScale, scenePositions, sceneColors);
+		glGenBuffers(1, &scenebuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, scenebuffer);
+		glBufferData(GL_ARRAY_BUFFER, scenePositions.size() * sizeof(glm::vec3), scenePositions.data(), GL_STATIC_DRAW);
+		glGenBuffers(1, &scenecolorbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, scenecolorbuffer);
+		glBufferData(GL_ARRAY_BUFFER, sceneColors.size() * sizeof(glm::vec3), sceneColors.data(), GL_STATIC_DRAW);
+		// Projectiles move every frame but their count and colors do not, only their positions are rewritten
+		scenegen::flatten(scene, scene.projectile, scene.projectiles, sceneScale, projectilePositions, projectileColors,
+		                  projectileBatches);
+		glGenBuffers(1, &projectilebuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, projectilebuffer);
+		glBufferData(GL_ARRAY_BUFFER, projectilePositions.size() * sizeof(glm::vec3), projectilePositions.data(), GL_STREAM_DRAW);
+		glGenBuffers(1, &projectilecolorbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, projectilecolorbuffer);
+		glBufferData(GL_ARRAY_BUFFER, projectileColors.size() * sizeof(glm::vec3), projectileColors.data(), GL_STATIC_DRAW);
+	}
+	scenegen::FrameTimer frameTimer(options.benchFrames);
+	double lastTime = glfwGetTime();
+
     float count_a = 0.0f;
     float count_b = 10.0f;
     float count_c = -10.0f;
@@ -238,7 +292,32 @@ int main( void )
 		);
 
 		// Draw the triangleS !
-		glDrawArrays(GL_TRIANGLES, 0, 12*3); // 12*3 indices starting at 0 -> 12 triangles
+		if (!options.hasScene) {
+			glDrawArrays(GL_TRIANGLES, 0, 12*3); // 12*3 indices starting at 0 -> 12 triangles
+		} else {
+			// One draw per material, as a real renderer would switch state between them
+			glBindBuffer(GL_ARRAY_BUFFER, scenebuffer);
+			glVertexAttribPointer(vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			glBindBuffer(GL_ARRAY_BUFFER, scenecolorbuffer);
+			glVertexAttribPointer(vertexColorID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			for (const auto& batch : sceneBatches) {
+				glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
+			}
+
+			const double now = glfwGetTime();
+			scenegen::advance(scene, float(now - lastTime));
+			lastTime = now;
+			scenegen::flatten(scene, scene.projectile, scene.projectiles, sceneScale, projectilePositions, projectileColors,
+			                  projectileBatches);
+			glBindBuffer(GL_ARRAY_BUFFER, projectilebuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, projectilePositions.size() * sizeof(glm::vec3), projectilePositions.data());
+			glVertexAttribPointer(vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			glBindBuffer(GL_ARRAY_BUFFER, projectilecolorbuffer);
+			glVertexAttribPointer(vertexColorID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			for (const auto& batch : projectileBatches) {
+				glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
+			}
+		}
 
 		glDisableVertexAttribArray(vertexPosition_modelspaceID);
 		glDisableVertexAttribArray(vertexColorID);
@@ -247,15 +326,31 @@ int main( void )
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 
+		if (frameTimer.tick(glfwGetTime())) {
+			break;
+		}
+
 	} // Check if the ESC key was pressed or the window was closed
 	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 );
 
+	if (options.benchFrames > 0) {
+		frameTimer.print("hw1_tetrahedron");
+		if (!options.benchCsv.empty()) {
+			frameTimer.writeCsv(options.benchCsv, "hw1_tetrahedron", options.params);
+		}
+	}
+
 	// Cleanup VBO and shader
 	glDeleteBuffers(1, &vertexbuffer);
 	glDeleteBuffers(1, &colorbuffer);
+	glDeleteBuffers(1, &scenebuffer);
+	glDeleteBuffers(1, &scenecolorbuffer);
+	glDeleteBuffers(1, &projectilebuffer);
+	glDeleteBuffers(1, &projectilecolorbuffer);
 	glDeleteProgram(programID);
 
+	gltrace::end();
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
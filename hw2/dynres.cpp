@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "dynres.hpp"
+
+namespace dynres {
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Controller      //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+Controller::Controller(double targetMilliseconds, float minScale, int maxSamples)
+        : target(targetMilliseconds), minScale(minScale), maxSamples(maxSamples), samples(maxSamples) {
+}
+
+void Controller::changed() {
+    // Timings still in flight belong to the old settings, DynamicResolution drops them
+    smoothed = 0.0;
+    framesMeasured = 0;
+    ++changes;
+}
+
+void Controller::addSample(double milliseconds) {
+    sampleSum += milliseconds;
+    ++sampleCount;
+    smoothed = framesMeasured == 0 ? milliseconds : 0.8 * smoothed + 0.2 * milliseconds;
+    ++framesMeasured;
+
+    // GPU time grows with the pixel count, so the scale moves with the square root
+    const float ratio = float(std::sqrt(target / smoothed));
+    if (smoothed > target * 1.05 && framesMeasured >= downgradeDelay) {
+        if (samples > 1) {
+            samples /= 2;
+            changed();
+        } else if (scale > minScale) {
+            scale = std::max(minScale, scale * std::max(0.8f, std::min(ratio, 0.98f)));
+            changed();
+        }
+    } else if (smoothed < target * 0.8 && framesMeasured >= upgradeDelay) {
+        if (scale < 1.f) {
+            scale = std::min(1.f, scale * std::max(1.02f, std::min(ratio, 1.1f)));
+            changed();
+        } else if (samples < maxSamples) {
+            samples *= 2;
+            changed();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      GpuTimer        //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+GpuTimer::GpuTimer() {
+    glGenQueries(queryCount, queries);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(queryCount, queries);
+}
+
+void GpuTimer::begin(int tag) {
+    running = !pending[next];
+    if (running) {
+        tags[next] = tag;
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+}
+
+void GpuTimer::end() {
+    if (running) {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % queryCount;
+        running = false;
+    }
+}
+
+bool GpuTimer::poll(double& milliseconds, int& tag) {
+    if (!pending[oldest]) {
+        return false;
+    }
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return false;
+    }
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &nanoseconds);
+    pending[oldest] = false;
+    milliseconds = nanoseconds * 1e-6;
+    tag = tags[oldest];
+    oldest = (oldest + 1) % queryCount;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////  DynamicResolution   //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+bool DynamicResolution::isSupported() {
+    return (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+}
+
+static int supportedSamples() {
+    GLint samples = 1;
+    glGetIntegerv(GL_MAX_SAMPLES, &samples);
+    int supported = 1;
+    const int limit = std::min<int>(samples, int(DynamicResolution::maxSamples));
+    while (supported * 2 <= limit) {
+        supported *= 2;
+    }
+    return supported;
+}
+
+DynamicResolution::DynamicResolution(int windowWidth, int windowHeight, double targetMilliseconds)
+        : windowWidth(windowWidth), windowHeight(windowHeight), width(windowWidth), height(windowHeight),
+          controller(targetMilliseconds, 0.5f, supportedSamples()) {
+    for (int level = 0; level < 3; ++level) {
+        Target& target = targets[level];
+        target.samples = 1 << level;
+        if (target.samples > controller.getSamples()) {
+            break;
+        }
+        glGenRenderbuffers(1, &target.color);
+        glBindRenderbuffer(GL_RENDERBUFFER, target.color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, level == 0 ? 0 : target.samples, GL_RGBA8,
+                                         windowWidth, windowHeight);
+        glGenRenderbuffers(1, &target.depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, level == 0 ? 0 : target.samples, GL_DEPTH_COMPONENT24,
+                                         windowWidth, windowHeight);
+
+        glGenFramebuffers(1, &target.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Offscreen framebuffer with %d samples is incomplete\n", target.samples);
+        }
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+DynamicResolution::~DynamicResolution() {
+    for (Target& target : targets) {
+        if (target.framebuffer) {
+            glDeleteFramebuffers(1, &target.framebuffer);
+            glDeleteRenderbuffers(1, &target.color);
+            glDeleteRenderbuffers(1, &target.depth);
+        }
+    }
+}
+
+DynamicResolution::Target& DynamicResolution::current() {
+    const int samples = controller.getSamples();
+    return targets[samples >= 4 ? 2 : samples >= 2 ? 1 : 0];
+}
+
+void DynamicResolution::begin() {
+    // Frames measured before the last change of settings say nothing about the current ones
+    double milliseconds;
+    int tag;
+    while (timer.poll(milliseconds, tag)) {
+        if (tag == controller.getChanges()) {
+            controller.addSample(milliseconds);
+        }
+    }
+
+    width = std::max(1, int(std::lround(windowWidth * controller.getScale())));
+    height = std::max(1, int(std::lround(windowHeight * controller.getScale())));
+
+    timer.begin(controller.getChanges());
+    glBindFramebuffer(GL_FRAMEBUFFER, current().framebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void DynamicResolution::end() {
+    Target& source = current();
+    if (source.samples > 1) {
+        // Multisampled framebuffers can only be blitted at the same size, resolve first
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, source.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targets[0].framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, targets[0].framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    timer.end();
+}
+
+} // namespace dynres
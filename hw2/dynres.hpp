@@ -0,0 +1,124 @@
+#ifndef DYNRES_HPP
+#define DYNRES_HPP
+
+// Dynamic resolution for hw2.
+//
+// The scene is drawn into an offscreen framebuffer instead of the window. Its
+// resolution (a fraction of the window) and MSAA level are picked every frame
+// by Controller, which is fed the GPU time of past frames from a ring of
+// GL_TIME_ELAPSED queries read back without stalling. When frames are too slow
+// MSAA is reduced first, then resolution; when there is headroom resolution
+// comes back first, then MSAA. Each query is tagged with the settings it
+// measured, so after a change the results still in flight are dropped instead
+// of being judged against the new settings. The frame is resolved and
+// stretched to the window with glBlitFramebuffer, after which the HUD is drawn
+// at native resolution.
+//
+// One framebuffer per MSAA level is allocated at window size up front, so a
+// new resolution is only a new viewport and nothing is allocated per frame.
+
+#include <glm/glm.hpp>
+
+namespace dynres {
+
+class Controller {
+public:
+    static constexpr int downgradeDelay = 4;  // frames measured before going down again
+    static constexpr int upgradeDelay = 30;   // frames of sustained headroom before going up
+
+    Controller(double targetMilliseconds, float minScale, int maxSamples);
+
+    // GPU time of one frame rendered with the current settings
+    void addSample(double milliseconds);
+
+    float getScale() const { return scale; }
+    int getSamples() const { return samples; }
+    double getTarget() const { return target; }
+    double getAverage() const { return sampleCount > 0 ? sampleSum / sampleCount : 0.0; }
+    // Also identifies the current settings: timings tagged with an older count are stale
+    int getChanges() const { return changes; }
+
+private:
+    void changed();
+
+    double target;
+    float minScale;
+    int maxSamples;
+
+    float scale = 1.f;
+    int samples;
+    double smoothed = 0.0;
+    int framesMeasured = 0;
+    int changes = 0;
+    double sampleSum = 0.0;
+    long sampleCount = 0;
+};
+
+// GL_TIME_ELAPSED queries in flight over several frames
+class GpuTimer {
+public:
+    static constexpr int queryCount = 4;
+
+    GpuTimer();
+    ~GpuTimer();
+
+    // A frame is skipped when every query is still waiting for the GPU.
+    // `tag` is handed back by poll() with the measurement.
+    void begin(int tag);
+    void end();
+
+    // Oldest finished measurement, false when none is ready
+    bool poll(double& milliseconds, int& tag);
+
+private:
+    GLuint queries[queryCount];
+    int tags[queryCount] = {};
+    bool pending[queryCount] = {};
+    int next = 0;    // query used by the next begin()
+    int oldest = 0;  // oldest query that may be pending
+    bool running = false;
+};
+
+class DynamicResolution {
+public:
+    static constexpr int maxSamples = 4;
+
+    // Needs framebuffer objects with multisampling and blits, and timer queries
+    static bool isSupported();
+
+    DynamicResolution(int windowWidth, int windowHeight, double targetMilliseconds);
+    ~DynamicResolution();
+
+    // Binds the offscreen framebuffer at the resolution picked for this frame
+    void begin();
+    // Resolves and stretches the frame to the window; its depth is cleared for the HUD
+    void end();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getSamples() const { return controller.getSamples(); }
+    const Controller& getController() const { return controller; }
+
+private:
+    struct Target {
+        int samples = 0;
+        GLuint framebuffer = 0;
+        GLuint color = 0;
+        GLuint depth = 0;
+    };
+
+    Target& current();
+
+    int windowWidth;
+    int windowHeight;
+    int width;
+    int height;
+
+    Target targets[3]; // 1, 2 and 4 samples; the single sample one also receives resolves
+    Controller controller;
+    GpuTimer timer;
+};
+
+} // namespace dynres
+
+#endif // DYNRES_HPP
@@ -0,0 +1,600 @@
+#ifndef GLTRACE_HPP
+#define GLTRACE_HPP
+
+// GL command-stream capture.
+//
+// Include this header after GLEW, GLFW and common/shader.hpp. Every GL call the
+// demo issues through the names listed at the bottom of the file is redirected
+// to a wrapper which appends a compact binary record to the trace (if a capture
+// is running) and then forwards to the real driver entry point.
+// The trace is replayed offscreen by gltrace_replay (see gltrace_replay.cpp),
+// which defines GLTRACE_FORMAT_ONLY to get the opcodes without the wrappers.
+//
+// Trace layout: "GLTR", uint32 version, then a flat list of records.
+// Every record is a one byte opcode followed by its fixed payload; strings and
+// blobs are stored as uint32 size + bytes. Everything is little endian.
+// The first record is always a glViewport with the initial viewport, which is
+// the size of the window the demo draws into.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+namespace gltrace {
+
+const char magic[4] = {'G', 'L', 'T', 'R'};
+const uint32_t version = 2;
+
+enum Op : uint8_t {
+    OpEndFrame = 0,
+    OpDefineProgram,
+    OpUseProgram,
+    OpUniform1i,
+    OpUniform1f,
+    OpUniform2f,
+    OpUniform3f,
+    OpUniform4f,
+    OpUniform3fv,
+    OpUniform4fv,
+    OpUniformMatrix4fv,
+    OpBindBuffer,
+    OpBufferData,
+    OpBufferSubData,
+    OpEnableVertexAttribArray,
+    OpDisableVertexAttribArray,
+    OpVertexAttribPointer,
+    OpDrawArrays,
+    OpDrawElements,
+    OpActiveTexture,
+    OpBindTexture,
+    OpTexImage2D,
+    OpTexSubImage2D,
+    OpTexParameteri,
+    OpEnable,
+    OpDisable,
+    OpDepthFunc,
+    OpDepthMask,
+    OpBlendFunc,
+    OpClearColor,
+    OpClear,
+    OpViewport,
+    OpCompressedTexImage2D,
+    OpCount
+};
+
+// Bytes per pixel of a client side image, 0 if the format is not understood.
+inline size_t pixelSize(GLenum format, GLenum type) {
+    size_t components = 0;
+    switch (format) {
+        case GL_RED: case GL_ALPHA: case GL_LUMINANCE: case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG: case GL_LUMINANCE_ALPHA: components = 2; break;
+        case GL_RGB: case GL_BGR: components = 3; break;
+        case GL_RGBA: case GL_BGRA: components = 4; break;
+        default: return 0;
+    }
+    switch (type) {
+        case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+        case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+        case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return components * 4;
+        default: return 0;
+    }
+}
+
+#ifndef GLTRACE_FORMAT_ONLY
+
+struct Capture {
+    FILE* file = nullptr;
+    std::set<GLuint> programs;  // programs whose definition is already in the trace
+    std::set<GLuint> textures;  // textures whose contents are already in the trace
+    uint64_t calls = 0;
+    uint64_t frames = 0;
+};
+
+inline Capture& capture() {
+    static Capture instance;
+    return instance;
+}
+
+inline bool capturing() {
+    return capture().file != nullptr;
+}
+
+template <typename T>
+inline void put(const T& value) {
+    fwrite(&value, sizeof(T), 1, capture().file);
+}
+
+inline void putBlob(const void* data, uint32_t size) {
+    put(size);
+    if (size > 0) {
+        fwrite(data, 1, size, capture().file);
+    }
+}
+
+inline void putString(const std::string& str) {
+    putBlob(str.data(), uint32_t(str.size()));
+}
+
+inline void putOp(Op op) {
+    Capture& c = capture();
+    if (c.calls == 0 && op != OpViewport) {
+        // A context is current by now, its default viewport covers the whole window
+        GLint viewport[4] = {0, 0, 0, 0};
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        put(uint8_t(OpViewport));
+        for (GLint value : viewport) {
+            put(value);
+        }
+        ++c.calls;
+    }
+    put(uint8_t(op));
+    ++c.calls;
+}
+
+inline bool begin(const char* path) {
+    Capture& c = capture();
+    c.file = fopen(path, "wb");
+    if (c.file == nullptr) {
+        fprintf(stderr, "Impossible to open trace file %s\n", path);
+        return false;
+    }
+    setvbuf(c.file, nullptr, _IOFBF, 1 << 20);
+    fwrite(magic, 1, sizeof(magic), c.file);
+    put(version);
+    c.programs.clear();
+    c.textures.clear();
+    c.calls = 0;
+    c.frames = 0;
+    return true;
+}
+
+inline void end() {
+    Capture& c = capture();
+    if (c.file == nullptr) {
+        return;
+    }
+    fclose(c.file);
+    c.file = nullptr;
+    printf("Captured %llu calls in %llu frames\n", (unsigned long long)c.calls, (unsigned long long)c.frames);
+}
+
+inline std::string readFile(const char* path) {
+    std::ifstream stream(path, std::ios::in);
+    std::stringstream sstr;
+    sstr << stream.rdbuf();
+    return sstr.str();
+}
+
+// Programs are recorded with their sources and the attribute/uniform locations
+// the driver assigned, so the replayer can rebuild an equivalent program and
+// remap the uniform locations it finds in the stream.
+inline void defineProgram(GLuint program, const char* vertexPath, const char* fragmentPath) {
+    putOp(OpDefineProgram);
+    put(program);
+    putString(readFile(vertexPath));
+    putString(readFile(fragmentPath));
+
+    char name[256];
+    GLsizei length;
+    GLint size;
+    GLenum type;
+
+    std::vector<std::pair<std::string, GLint>> attributes;
+    GLint count = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type, name);
+        GLint location = glGetAttribLocation(program, name);
+        if (location >= 0) {
+            attributes.push_back({name, location});
+        }
+    }
+
+    std::vector<std::pair<std::string, GLint>> uniforms;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+        std::string base(name);
+        if (size > 1 && base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0) {
+            base.resize(base.size() - 3);
+            for (GLint element = 0; element < size; ++element) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                uniforms.push_back({elementName, glGetUniformLocation(program, elementName.c_str())});
+            }
+        } else {
+            uniforms.push_back({base, glGetUniformLocation(program, name)});
+        }
+    }
+
+    put(uint32_t(attributes.size()));
+    for (const auto& attribute : attributes) {
+        putString(attribute.first);
+        put(attribute.second);
+    }
+    put(uint32_t(uniforms.size()));
+    for (const auto& uniform : uniforms) {
+        putString(uniform.first);
+        put(uniform.second);
+    }
+    capture().programs.insert(program);
+}
+
+// Textures loaded by common/texture.cpp never go through the wrappers, so the
+// first time such a texture is bound its whole mip chain is read back and
+// recorded, compressed levels as they are, along with its filtering and
+// wrapping, so the replay samples it at the same cost.
+inline void snapshotTexture(GLenum target, GLuint texture) {
+    if (target != GL_TEXTURE_2D || texture == 0 || !capture().textures.insert(texture).second) {
+        return;
+    }
+    std::vector<uint8_t> pixels;
+    for (GLint level = 0;; ++level) {
+        GLint width = 0, height = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width <= 0 || height <= 0) {
+            break;
+        }
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint format = 0, size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            pixels.resize(size_t(std::max(0, size)));
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+
+            putOp(OpCompressedTexImage2D);
+            put(GLenum(GL_TEXTURE_2D)); put(level); put(GLenum(format));
+            put(GLsizei(width)); put(GLsizei(height));
+        } else {
+            pixels.resize(size_t(width) * height * 4);
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+            putOp(OpTexImage2D);
+            put(GLenum(GL_TEXTURE_2D)); put(level); put(GLint(GL_RGBA8));
+            put(GLsizei(width)); put(GLsizei(height));
+            put(GLenum(GL_RGBA)); put(GLenum(GL_UNSIGNED_BYTE));
+        }
+        putBlob(pixels.data(), uint32_t(pixels.size()));
+        if (width == 1 && height == 1) {
+            break;
+        }
+    }
+
+    const GLenum parameters[] = {GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T,
+                                 GL_TEXTURE_BASE_LEVEL, GL_TEXTURE_MAX_LEVEL};
+    for (GLenum parameter : parameters) {
+        GLint value = 0;
+        glGetTexParameteriv(GL_TEXTURE_2D, parameter, &value);
+        putOp(OpTexParameteri);
+        put(GLenum(GL_TEXTURE_2D)); put(parameter); put(value);
+    }
+}
+
+// Client images are stored with tightly packed rows whatever GL_UNPACK_ALIGNMENT is.
+inline void putImage(GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels) {
+    const size_t bpp = pixelSize(format, type);
+    if (pixels == nullptr || bpp == 0 || width <= 0 || height <= 0) {
+        putBlob(nullptr, 0);
+        return;
+    }
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    const size_t row = bpp * width;
+    const size_t stride = (row + alignment - 1) / alignment * alignment;
+    put(uint32_t(row * height));
+    for (GLsizei y = 0; y < height; ++y) {
+        fwrite(static_cast<const uint8_t*>(pixels) + stride * y, 1, row, capture().file);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Wrappers        //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+inline GLuint LoadShaders(const char* vertexPath, const char* fragmentPath) {
+    GLuint program = ::LoadShaders(vertexPath, fragmentPath);
+    if (capturing()) {
+        defineProgram(program, vertexPath, fragmentPath);
+    }
+    return program;
+}
+
+inline void UseProgram(GLuint program) {
+    if (capturing()) {
+        putOp(OpUseProgram); put(program);
+    }
+    glUseProgram(program);
+}
+
+inline void Uniform1i(GLint location, GLint v0) {
+    if (capturing()) {
+        putOp(OpUniform1i); put(location); put(v0);
+    }
+    glUniform1i(location, v0);
+}
+
+inline void Uniform1f(GLint location, GLfloat v0) {
+    if (capturing()) {
+        putOp(OpUniform1f); put(location); put(v0);
+    }
+    glUniform1f(location, v0);
+}
+
+inline void Uniform2f(GLint location, GLfloat v0, GLfloat v1) {
+    if (capturing()) {
+        putOp(OpUniform2f); put(location); put(v0); put(v1);
+    }
+    glUniform2f(location, v0, v1);
+}
+
+inline void Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+    if (capturing()) {
+        putOp(OpUniform3f); put(location); put(v0); put(v1); put(v2);
+    }
+    glUniform3f(location, v0, v1, v2);
+}
+
+inline void Uniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) {
+    if (capturing()) {
+        putOp(OpUniform4f); put(location); put(v0); put(v1); put(v2); put(v3);
+    }
+    glUniform4f(location, v0, v1, v2, v3);
+}
+
+inline void Uniform3fv(GLint location, GLsizei count, const GLfloat* value) {
+    if (capturing()) {
+        putOp(OpUniform3fv); put(location); putBlob(value, uint32_t(count * 3 * sizeof(GLfloat)));
+    }
+    glUniform3fv(location, count, value);
+}
+
+inline void Uniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+    if (capturing()) {
+        putOp(OpUniform4fv); put(location); putBlob(value, uint32_t(count * 4 * sizeof(GLfloat)));
+    }
+    glUniform4fv(location, count, value);
+}
+
+inline void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    if (capturing()) {
+        putOp(OpUniformMatrix4fv); put(location); put(transpose);
+        putBlob(value, uint32_t(count * 16 * sizeof(GLfloat)));
+    }
+    glUniformMatrix4fv(location, count, transpose, value);
+}
+
+inline void BindBuffer(GLenum target, GLuint buffer) {
+    if (capturing()) {
+        putOp(OpBindBuffer); put(target); put(buffer);
+    }
+    glBindBuffer(target, buffer);
+}
+
+inline void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    if (capturing()) {
+        putOp(OpBufferData); put(target); put(uint64_t(size)); put(usage);
+        putBlob(data, data != nullptr ? uint32_t(size) : 0);
+    }
+    glBufferData(target, size, data, usage);
+}
+
+inline void BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    if (capturing()) {
+        putOp(OpBufferSubData); put(target); put(uint64_t(offset));
+        putBlob(data, uint32_t(size));
+    }
+    glBufferSubData(target, offset, size, data);
+}
+
+inline void EnableVertexAttribArray(GLuint index) {
+    if (capturing()) {
+        putOp(OpEnableVertexAttribArray); put(index);
+    }
+    glEnableVertexAttribArray(index);
+}
+
+inline void DisableVertexAttribArray(GLuint index) {
+    if (capturing()) {
+        putOp(OpDisableVertexAttribArray); put(index);
+    }
+    glDisableVertexAttribArray(index);
+}
+
+inline void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                const void* pointer) {
+    if (capturing()) {
+        putOp(OpVertexAttribPointer); put(index); put(size); put(type); put(normalized); put(stride);
+        put(uint64_t(reinterpret_cast<uintptr_t>(pointer)));
+    }
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+inline void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    if (capturing()) {
+        putOp(OpDrawArrays); put(mode); put(first); put(count);
+    }
+    glDrawArrays(mode, first, count);
+}
+
+inline void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+    if (capturing()) {
+        putOp(OpDrawElements); put(mode); put(count); put(type);
+        put(uint64_t(reinterpret_cast<uintptr_t>(indices)));
+    }
+    glDrawElements(mode, count, type, indices);
+}
+
+inline void ActiveTexture(GLenum texture) {
+    if (capturing()) {
+        putOp(OpActiveTexture); put(texture);
+    }
+    glActiveTexture(texture);
+}
+
+inline void BindTexture(GLenum target, GLuint texture) {
+    if (capturing()) {
+        putOp(OpBindTexture); put(target); put(texture);
+    }
+    glBindTexture(target, texture);
+    if (capturing()) {
+        snapshotTexture(target, texture);
+    }
+}
+
+inline void TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                       GLint border, GLenum format, GLenum type, const void* pixels) {
+    if (capturing()) {
+        putOp(OpTexImage2D); put(target); put(level); put(internalformat);
+        put(width); put(height); put(format); put(type);
+        putImage(width, height, format, type, pixels);
+    }
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+inline void TexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                          GLenum format, GLenum type, const void* pixels) {
+    if (capturing()) {
+        putOp(OpTexSubImage2D); put(target); put(level); put(xoffset); put(yoffset);
+        put(width); put(height); put(format); put(type);
+        putImage(width, height, format, type, pixels);
+    }
+    glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+inline void TexParameteri(GLenum target, GLenum pname, GLint param) {
+    if (capturing()) {
+        putOp(OpTexParameteri); put(target); put(pname); put(param);
+    }
+    glTexParameteri(target, pname, param);
+}
+
+inline void Enable(GLenum cap) {
+    if (capturing()) {
+        putOp(OpEnable); put(cap);
+    }
+    glEnable(cap);
+}
+
+inline void Disable(GLenum cap) {
+    if (capturing()) {
+        putOp(OpDisable); put(cap);
+    }
+    glDisable(cap);
+}
+
+inline void DepthFunc(GLenum func) {
+    if (capturing()) {
+        putOp(OpDepthFunc); put(func);
+    }
+    glDepthFunc(func);
+}
+
+inline void DepthMask(GLboolean flag) {
+    if (capturing()) {
+        putOp(OpDepthMask); put(flag);
+    }
+    glDepthMask(flag);
+}
+
+inline void BlendFunc(GLenum sfactor, GLenum dfactor) {
+    if (capturing()) {
+        putOp(OpBlendFunc); put(sfactor); put(dfactor);
+    }
+    glBlendFunc(sfactor, dfactor);
+}
+
+inline void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    if (capturing()) {
+        putOp(OpClearColor); put(red); put(green); put(blue); put(alpha);
+    }
+    glClearColor(red, green, blue, alpha);
+}
+
+inline void Clear(GLbitfield mask) {
+    if (capturing()) {
+        putOp(OpClear); put(mask);
+    }
+    glClear(mask);
+}
+
+inline void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (capturing()) {
+        putOp(OpViewport); put(x); put(y); put(width); put(height);
+    }
+    glViewport(x, y, width, height);
+}
+
+inline void SwapBuffers(GLFWwindow* window) {
+    if (capturing()) {
+        put(uint8_t(OpEndFrame));
+        ++capture().frames;
+    }
+    glfwSwapBuffers(window);
+}
+
+#endif // GLTRACE_FORMAT_ONLY
+
+} // namespace gltrace
+
+#ifndef GLTRACE_FORMAT_ONLY
+
+#undef glUseProgram
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2f
+#undef glUniform3f
+#undef glUniform4f
+#undef glUniform3fv
+#undef glUniform4fv
+#undef glUniformMatrix4fv
+#undef glBindBuffer
+#undef glBufferData
+#undef glBufferSubData
+#undef glEnableVertexAttribArray
+#undef glDisableVertexAttribArray
+#undef glVertexAttribPointer
+#undef glActiveTexture
+
+#define LoadShaders gltrace::LoadShaders
+#define glUseProgram gltrace::UseProgram
+#define glUniform1i gltrace::Uniform1i
+#define glUniform1f gltrace::Uniform1f
+#define glUniform2f gltrace::Uniform2f
+#define glUniform3f gltrace::Uniform3f
+#define glUniform4f gltrace::Uniform4f
+#define glUniform3fv gltrace::Uniform3fv
+#define glUniform4fv gltrace::Uniform4fv
+#define glUniformMatrix4fv gltrace::UniformMatrix4fv
+#define glBindBuffer gltrace::BindBuffer
+#define glBufferData gltrace::BufferData
+#define glBufferSubData gltrace::BufferSubData
+#define glEnableVertexAttribArray gltrace::EnableVertexAttribArray
+#define glDisableVertexAttribArray gltrace::DisableVertexAttribArray
+#define glVertexAttribPointer gltrace::VertexAttribPointer
+#define glDrawArrays gltrace::DrawArrays
+#define glDrawElements gltrace::DrawElements
+#define glActiveTexture gltrace::ActiveTexture
+#define glBindTexture gltrace::BindTexture
+#define glTexImage2D gltrace::TexImage2D
+#define glTexSubImage2D gltrace::TexSubImage2D
+#define glTexParameteri gltrace::TexParameteri
+#define glEnable gltrace::Enable
+#define glDisable gltrace::Disable
+#define glDepthFunc gltrace::DepthFunc
+#define glDepthMask gltrace::DepthMask
+#define glBlendFunc gltrace::BlendFunc
+#define glClearColor gltrace::ClearColor
+#define glClear gltrace::Clear
+#define glViewport gltrace::Viewport
+#define glfwSwapBuffers gltrace::SwapBuffers
+
+#endif // GLTRACE_FORMAT_ONLY
+
+#endif // GLTRACE_HPP
@@ -0,0 +1,631 @@
+// Offscreen replayer for traces written by gltrace.hpp.
+//
+// usage: gltrace_replay <trace> [--loops N] [--no-finish] [--no-warmup]
+//
+// The whole trace is decoded up front, then re-issued as fast as possible into
+// an offscreen framebuffer the size of the captured window, with 4x MSAA like
+// the demos ask for. A hidden window only provides the context: drivers may
+// skip rasterization for pixels of an invisible window, which would leave the
+// fragment cost out of the timings. Every frame is resolved, as a swap would,
+// and ends with glFinish (unless --no-finish) so the reported per-frame time
+// covers both submission and execution. The trace is replayed once before
+// measuring (unless --no-warmup) so shader compilation, first uploads and
+// driver warm-up stay out of the statistics.
+
+// Include standard headers
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <glfw3.h>
+
+#define GLTRACE_FORMAT_ONLY
+#include "gltrace.hpp"
+#include "../scenegen/scenegen.hpp"
+
+using gltrace::Op;
+
+struct Program {
+    GLuint capturedId;
+    std::string vertexSource;
+    std::string fragmentSource;
+    std::vector<std::pair<std::string, GLint>> attributes;
+    std::vector<std::pair<std::string, GLint>> uniforms;
+
+    GLuint id = 0;
+    std::map<GLint, GLint> locations; // captured uniform location -> replay location
+};
+
+// One decoded record. Integer and float arguments live inline, variable sized
+// payloads point straight into the trace buffer.
+struct Command {
+    Op op;
+    GLint i[8];
+    GLfloat f[4];
+    uint64_t offset;
+    const uint8_t* data;
+    uint32_t size;
+};
+
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& buffer) : buffer(buffer) {}
+
+    bool done() const {
+        return position >= buffer.size();
+    }
+
+    template <typename T>
+    T get() {
+        T value;
+        check(sizeof(T));
+        memcpy(&value, &buffer[position], sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    const uint8_t* getBlob(uint32_t& size) {
+        size = get<uint32_t>();
+        check(size);
+        const uint8_t* data = size > 0 ? &buffer[position] : nullptr;
+        position += size;
+        return data;
+    }
+
+    std::string getString() {
+        uint32_t size;
+        const uint8_t* data = getBlob(size);
+        return std::string(reinterpret_cast<const char*>(data), size);
+    }
+
+private:
+    void check(size_t size) const {
+        if (position + size > buffer.size()) {
+            fprintf(stderr, "Truncated trace\n");
+            exit(1);
+        }
+    }
+
+    const std::vector<uint8_t>& buffer;
+    size_t position = 0;
+};
+
+static std::vector<Program> programs;
+static std::vector<Command> commands;
+
+void decode(const std::vector<uint8_t>& trace) {
+    if (trace.size() < 8 || memcmp(trace.data(), gltrace::magic, sizeof(gltrace::magic)) != 0) {
+        fprintf(stderr, "Not a GL trace\n");
+        exit(1);
+    }
+    Reader reader(trace);
+    reader.get<uint32_t>();
+    const uint32_t version = reader.get<uint32_t>();
+    if (version == 0 || version > gltrace::version) {
+        fprintf(stderr, "Unsupported trace version\n");
+        exit(1);
+    }
+
+    while (!reader.done()) {
+        Command c = {};
+        c.op = Op(reader.get<uint8_t>());
+        switch (c.op) {
+            case gltrace::OpEndFrame:
+                break;
+            case gltrace::OpDefineProgram: {
+                Program program;
+                program.capturedId = reader.get<GLuint>();
+                program.vertexSource = reader.getString();
+                program.fragmentSource = reader.getString();
+                for (uint32_t n = reader.get<uint32_t>(); n > 0; --n) {
+                    std::string name = reader.getString();
+                    program.attributes.push_back({name, reader.get<GLint>()});
+                }
+                for (uint32_t n = reader.get<uint32_t>(); n > 0; --n) {
+                    std::string name = reader.getString();
+                    program.uniforms.push_back({name, reader.get<GLint>()});
+                }
+                c.i[0] = GLint(programs.size());
+                programs.push_back(program);
+                break;
+            }
+            case gltrace::OpUseProgram:
+            case gltrace::OpEnableVertexAttribArray:
+            case gltrace::OpDisableVertexAttribArray:
+            case gltrace::OpActiveTexture:
+            case gltrace::OpEnable:
+            case gltrace::OpDisable:
+            case gltrace::OpDepthFunc:
+            case gltrace::OpClear:
+                c.i[0] = reader.get<GLint>();
+                break;
+            case gltrace::OpDepthMask:
+                c.i[0] = reader.get<GLboolean>();
+                break;
+            case gltrace::OpUniform1i:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLint>();
+                break;
+            case gltrace::OpUniform1f:
+            case gltrace::OpUniform2f:
+            case gltrace::OpUniform3f:
+            case gltrace::OpUniform4f:
+                c.i[0] = reader.get<GLint>();
+                for (int k = 0; k <= c.op - gltrace::OpUniform1f; ++k) {
+                    c.f[k] = reader.get<GLfloat>();
+                }
+                break;
+            case gltrace::OpUniform3fv:
+            case gltrace::OpUniform4fv:
+                c.i[0] = reader.get<GLint>();
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpUniformMatrix4fv:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLboolean>();
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpBindBuffer:
+            case gltrace::OpBindTexture:
+            case gltrace::OpBlendFunc:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLint>();
+                break;
+            case gltrace::OpBufferData:
+                c.i[0] = reader.get<GLint>();
+                c.offset = reader.get<uint64_t>();
+                c.i[1] = reader.get<GLint>();
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpBufferSubData:
+                c.i[0] = reader.get<GLint>();
+                c.offset = reader.get<uint64_t>();
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpVertexAttribPointer:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLint>();
+                c.i[2] = reader.get<GLint>();
+                c.i[3] = reader.get<GLboolean>();
+                c.i[4] = reader.get<GLint>();
+                c.offset = reader.get<uint64_t>();
+                break;
+            case gltrace::OpDrawArrays:
+            case gltrace::OpTexParameteri:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLint>();
+                c.i[2] = reader.get<GLint>();
+                break;
+            case gltrace::OpDrawElements:
+                c.i[0] = reader.get<GLint>();
+                c.i[1] = reader.get<GLint>();
+                c.i[2] = reader.get<GLint>();
+                c.offset = reader.get<uint64_t>();
+                break;
+            case gltrace::OpTexImage2D:
+                for (int k = 0; k < 7; ++k) {
+                    c.i[k] = reader.get<GLint>();
+                }
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpTexSubImage2D:
+                for (int k = 0; k < 8; ++k) {
+                    c.i[k] = reader.get<GLint>();
+                }
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpCompressedTexImage2D:
+                for (int k = 0; k < 5; ++k) {
+                    c.i[k] = reader.get<GLint>();
+                }
+                c.data = reader.getBlob(c.size);
+                break;
+            case gltrace::OpClearColor:
+                for (int k = 0; k < 4; ++k) {
+                    c.f[k] = reader.get<GLfloat>();
+                }
+                break;
+            case gltrace::OpViewport:
+                for (int k = 0; k < 4; ++k) {
+                    c.i[k] = reader.get<GLint>();
+                }
+                break;
+            default:
+                fprintf(stderr, "Unknown opcode %d\n", int(c.op));
+                exit(1);
+        }
+        commands.push_back(c);
+    }
+}
+
+GLuint compileShader(GLenum type, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    const char* pointer = source.c_str();
+    glShaderSource(shader, 1, &pointer, NULL);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s\n", log);
+    }
+    return shader;
+}
+
+void buildProgram(Program& program) {
+    if (program.id != 0) {
+        return;
+    }
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, program.vertexSource);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, program.fragmentSource);
+    program.id = glCreateProgram();
+    glAttachShader(program.id, vertexShader);
+    glAttachShader(program.id, fragmentShader);
+    // Attribute indices are baked into the stream, so pin them before linking
+    for (const auto& attribute : program.attributes) {
+        glBindAttribLocation(program.id, attribute.second, attribute.first.c_str());
+    }
+    glLinkProgram(program.id);
+    glDetachShader(program.id, vertexShader);
+    glDetachShader(program.id, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    for (const auto& uniform : program.uniforms) {
+        program.locations[uniform.second] = glGetUniformLocation(program.id, uniform.first.c_str());
+    }
+}
+
+struct Replayer {
+    std::map<GLuint, Program*> programById;
+    std::map<GLuint, GLuint> buffers;
+    std::map<GLuint, GLuint> textures;
+    Program* current = nullptr;
+
+    GLuint buffer(GLuint captured) {
+        if (captured == 0) {
+            return 0;
+        }
+        GLuint& id = buffers[captured];
+        if (id == 0) {
+            glGenBuffers(1, &id);
+        }
+        return id;
+    }
+
+    GLuint texture(GLuint captured) {
+        if (captured == 0) {
+            return 0;
+        }
+        GLuint& id = textures[captured];
+        if (id == 0) {
+            glGenTextures(1, &id);
+        }
+        return id;
+    }
+
+    GLint location(GLint captured) const {
+        if (current == nullptr) {
+            return -1;
+        }
+        auto it = current->locations.find(captured);
+        return it != current->locations.end() ? it->second : -1;
+    }
+
+    const GLfloat* floats(const Command& c) const {
+        return reinterpret_cast<const GLfloat*>(c.data);
+    }
+
+    // Executes commands starting at `index` up to the end of the frame, returns
+    // the index of the next frame and adds the number of issued calls to `calls`.
+    size_t frame(size_t index, uint64_t& calls) {
+        for (; index < commands.size(); ++index) {
+            const Command& c = commands[index];
+            ++calls;
+            switch (c.op) {
+                case gltrace::OpEndFrame:
+                    --calls;
+                    return index + 1;
+                case gltrace::OpDefineProgram: {
+                    Program& program = programs[c.i[0]];
+                    buildProgram(program);
+                    programById[program.capturedId] = &program;
+                    break;
+                }
+                case gltrace::OpUseProgram: {
+                    auto it = programById.find(GLuint(c.i[0]));
+                    current = it != programById.end() ? it->second : nullptr;
+                    glUseProgram(current != nullptr ? current->id : 0);
+                    break;
+                }
+                case gltrace::OpUniform1i:
+                    glUniform1i(location(c.i[0]), c.i[1]);
+                    break;
+                case gltrace::OpUniform1f:
+                    glUniform1f(location(c.i[0]), c.f[0]);
+                    break;
+                case gltrace::OpUniform2f:
+                    glUniform2f(location(c.i[0]), c.f[0], c.f[1]);
+                    break;
+                case gltrace::OpUniform3f:
+                    glUniform3f(location(c.i[0]), c.f[0], c.f[1], c.f[2]);
+                    break;
+                case gltrace::OpUniform4f:
+                    glUniform4f(location(c.i[0]), c.f[0], c.f[1], c.f[2], c.f[3]);
+                    break;
+                case gltrace::OpUniform3fv:
+                    glUniform3fv(location(c.i[0]), c.size / (3 * sizeof(GLfloat)), floats(c));
+                    break;
+                case gltrace::OpUniform4fv:
+                    glUniform4fv(location(c.i[0]), c.size / (4 * sizeof(GLfloat)), floats(c));
+                    break;
+                case gltrace::OpUniformMatrix4fv:
+                    glUniformMatrix4fv(location(c.i[0]), c.size / (16 * sizeof(GLfloat)), GLboolean(c.i[1]), floats(c));
+                    break;
+                case gltrace::OpBindBuffer:
+                    glBindBuffer(c.i[0], buffer(c.i[1]));
+                    break;
+                case gltrace::OpBufferData:
+                    glBufferData(c.i[0], GLsizeiptr(c.offset), c.data, c.i[1]);
+                    break;
+                case gltrace::OpBufferSubData:
+                    glBufferSubData(c.i[0], GLintptr(c.offset), c.size, c.data);
+                    break;
+                case gltrace::OpEnableVertexAttribArray:
+                    glEnableVertexAttribArray(c.i[0]);
+                    break;
+                case gltrace::OpDisableVertexAttribArray:
+                    glDisableVertexAttribArray(c.i[0]);
+                    break;
+                case gltrace::OpVertexAttribPointer:
+                    glVertexAttribPointer(c.i[0], c.i[1], c.i[2], GLboolean(c.i[3]), c.i[4],
+                                          reinterpret_cast<const void*>(uintptr_t(c.offset)));
+                    break;
+                case gltrace::OpDrawArrays:
+                    glDrawArrays(c.i[0], c.i[1], c.i[2]);
+                    break;
+                case gltrace::OpDrawElements:
+                    glDrawElements(c.i[0], c.i[1], c.i[2], reinterpret_cast<const void*>(uintptr_t(c.offset)));
+                    break;
+                case gltrace::OpActiveTexture:
+                    glActiveTexture(c.i[0]);
+                    break;
+                case gltrace::OpBindTexture:
+                    glBindTexture(c.i[0], texture(c.i[1]));
+                    break;
+                case gltrace::OpTexImage2D:
+                    glTexImage2D(c.i[0], c.i[1], c.i[2], c.i[3], c.i[4], 0, c.i[5], c.i[6], c.data);
+                    break;
+                case gltrace::OpTexSubImage2D:
+                    glTexSubImage2D(c.i[0], c.i[1], c.i[2], c.i[3], c.i[4], c.i[5], c.i[6], c.i[7], c.data);
+                    break;
+                case gltrace::OpCompressedTexImage2D:
+                    glCompressedTexImage2D(c.i[0], c.i[1], c.i[2], c.i[3], c.i[4], 0, c.size, c.data);
+                    break;
+                case gltrace::OpTexParameteri:
+                    glTexParameteri(c.i[0], c.i[1], c.i[2]);
+                    break;
+                case gltrace::OpEnable:
+                    glEnable(c.i[0]);
+                    break;
+                case gltrace::OpDisable:
+                    glDisable(c.i[0]);
+                    break;
+                case gltrace::OpDepthFunc:
+                    glDepthFunc(c.i[0]);
+                    break;
+                case gltrace::OpDepthMask:
+                    glDepthMask(GLboolean(c.i[0]));
+                    break;
+                case gltrace::OpBlendFunc:
+                    glBlendFunc(c.i[0], c.i[1]);
+                    break;
+                case gltrace::OpClearColor:
+                    glClearColor(c.f[0], c.f[1], c.f[2], c.f[3]);
+                    break;
+                case gltrace::OpClear:
+                    glClear(c.i[0]);
+                    break;
+                case gltrace::OpViewport:
+                    glViewport(c.i[0], c.i[1], c.i[2], c.i[3]);
+                    break;
+                default:
+                    break;
+            }
+        }
+        return index;
+    }
+};
+
+// Multisampled framebuffer standing in for the window, resolved every frame
+struct Offscreen {
+    GLuint framebuffer = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    GLuint resolveFramebuffer = 0;
+    GLuint resolveColor = 0;
+    int width;
+    int height;
+
+    static bool isSupported() {
+        return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+    }
+
+    Offscreen(int width, int height) : width(width), height(height) {
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        const GLsizei samples = std::min(4, int(maxSamples));
+
+        glGenRenderbuffers(1, &resolveColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, resolveColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenFramebuffers(1, &resolveFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColor);
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Offscreen framebuffer with %d samples is incomplete\n", int(samples));
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    ~Offscreen() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        const GLuint framebuffers[2] = {framebuffer, resolveFramebuffer};
+        const GLuint renderbuffers[3] = {color, depth, resolveColor};
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteRenderbuffers(3, renderbuffers);
+    }
+
+    // What the swap does with a multisampled window, then back to drawing
+    void resolve() {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+};
+
+// Size of the captured window, from the viewport recorded in front of the trace
+void capturedSize(int& width, int& height) {
+    width = 1024;
+    height = 768;
+    for (const Command& c : commands) {
+        if (c.op == gltrace::OpViewport) {
+            width = std::max(1, c.i[0] + c.i[2]);
+            height = std::max(1, c.i[1] + c.i[3]);
+            return;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [--loops N] [--no-finish] [--no-warmup]\n", argv[0]);
+        return 1;
+    }
+    const char* tracePath = argv[1];
+    int loops = 1;
+    bool finish = true;
+    bool warmup = true;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            loops = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--no-finish") == 0) {
+            finish = false;
+        } else if (strcmp(argv[i], "--no-warmup") == 0) {
+            warmup = false;
+        }
+    }
+
+    std::ifstream file(tracePath, std::ios::binary);
+    if (!file.is_open()) {
+        fprintf(stderr, "Impossible to open %s\n", tracePath);
+        return 1;
+    }
+    std::vector<uint8_t> trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    decode(trace);
+
+    if (!glfwInit()) {
+        fprintf(stderr, "Failed to initialize GLFW\n");
+        return 1;
+    }
+    int width, height;
+    capturedSize(width, height);
+    glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, "gltrace replay", NULL, NULL);
+    if (window == NULL) {
+        fprintf(stderr, "Failed to open GLFW window.\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        glfwTerminate();
+        return 1;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    std::unique_ptr<Offscreen> offscreen;
+    if (Offscreen::isSupported()) {
+        offscreen.reset(new Offscreen(width, height));
+    } else {
+        fprintf(stderr, "Framebuffer objects are not available, replaying into the hidden window\n");
+    }
+    auto endFrame = [&]() {
+        if (offscreen) {
+            offscreen->resolve();
+        }
+    };
+
+    using clock = std::chrono::steady_clock;
+    Replayer replayer;
+    std::vector<double> frameTimes;
+    uint64_t calls = 0;
+    if (warmup) {
+        for (size_t index = 0; index < commands.size();) {
+            index = replayer.frame(index, calls);
+            endFrame();
+        }
+        glFinish();
+        calls = 0;
+    }
+    const auto start = clock::now();
+    for (int loop = 0; loop < loops; ++loop) {
+        for (size_t index = 0; index < commands.size();) {
+            const auto frameStart = clock::now();
+            index = replayer.frame(index, calls);
+            endFrame();
+            if (finish) {
+                glFinish();
+            }
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(clock::now() - frameStart).count());
+        }
+    }
+    glFinish();
+    const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    double mean = 0.0;
+    for (double time : frameTimes) {
+        mean += time;
+    }
+    mean /= std::max<size_t>(1, frameTimes.size());
+
+    printf("frames:      %zu\n", frameTimes.size());
+    printf("calls:       %llu\n", (unsigned long long)calls);
+    printf("time:        %.3f s\n", seconds);
+    printf("calls/sec:   %.0f\n", calls / seconds);
+    printf("frame ms:    mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", mean,
+           scenegen::percentile(frameTimes, 0.5), scenegen::percentile(frameTimes, 0.95),
+           scenegen::percentile(frameTimes, 0.99), scenegen::percentile(frameTimes, 1.0));
+
+    offscreen.reset();
+    glfwTerminate();
+    return 0;
+}
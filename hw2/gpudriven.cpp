@@ -0,0 +1,318 @@
+#include <cstdio>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <array>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <common/shader.hpp>
+
+#include "softrast.hpp"
+#include "gpudriven.hpp"
+
+namespace gpudriven {
+
+// Vertex clustering grid of each level of detail, in cells along the largest
+// side of the bounding box. 0 keeps the mesh as it is.
+static const int lodGrid[IndirectRenderer::lodCount] = {0, 8, 4};
+// Projected size (bounding radius / distance) below which the next level is used
+static const float lodScreenSizes[IndirectRenderer::lodCount - 1] = {0.1f, 0.04f};
+
+// Reads back level 0 of a GL texture, to be resampled into the texture array
+static softrast::Texture readTexture(GLuint id) {
+    softrast::Texture texture;
+    GLint previous = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texture.width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texture.height);
+    if (texture.width > 0 && texture.height > 0) {
+        texture.texels.resize(size_t(texture.width) * texture.height);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.texels.data());
+    }
+    glBindTexture(GL_TEXTURE_2D, previous);
+    return texture;
+}
+
+static GLuint loadComputeProgram(const char* path) {
+    std::ifstream stream(path, std::ios::in);
+    if (!stream.is_open()) {
+        fprintf(stderr, "Impossible to open %s.\n", path);
+        return 0;
+    }
+    std::stringstream sstr;
+    sstr << stream.rdbuf();
+    const std::string source = sstr.str();
+    const char* pointer = source.c_str();
+
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &pointer, NULL);
+    glCompileShader(shader);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    GLint result = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: %s\n", path, log);
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: %s\n", path, log);
+    }
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+    return program;
+}
+
+bool IndirectRenderer::isSupported() {
+    return GLEW_VERSION_4_3;
+}
+
+IndirectRenderer::IndirectRenderer() {
+    cullProgram = loadComputeProgram("CullComputeShader.computeshader");
+    entityCountID = glGetUniformLocation(cullProgram, "entityCount");
+    frustumPlanesID = glGetUniformLocation(cullProgram, "frustumPlanes");
+    cameraPositionID = glGetUniformLocation(cullProgram, "cameraPosition");
+    lodScreenSizesID = glGetUniformLocation(cullProgram, "lodScreenSizes");
+
+    drawProgram = LoadShaders("IndirectVertexShader.vertexshader", "IndirectFragmentShader.fragmentshader");
+    viewProjectionID = glGetUniformLocation(drawProgram, "VP");
+    texturesID = glGetUniformLocation(drawProgram, "textures");
+    lightingEnabledID = glGetUniformLocation(drawProgram, "lightingEnabled");
+    lightUniforms = lighting::Uniforms::locate(drawProgram);
+
+    glGenVertexArrays(1, &vertexArray);
+    GLuint buffers[5];
+    glGenBuffers(5, buffers);
+    vertexBuffer = buffers[0];
+    indexBuffer = buffers[1];
+    entityBuffer = buffers[2];
+    commandBuffer = buffers[3];
+    instanceBuffer = buffers[4];
+    glGenTextures(1, &textureArray);
+}
+
+IndirectRenderer::~IndirectRenderer() {
+    const GLuint buffers[5] = {vertexBuffer, indexBuffer, entityBuffer, commandBuffer, instanceBuffer};
+    glDeleteBuffers(5, buffers);
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteTextures(1, &textureArray);
+    glDeleteProgram(cullProgram);
+    glDeleteProgram(drawProgram);
+}
+
+int IndirectRenderer::addMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+                              const std::vector<glm::vec3>& normals) {
+    Mesh mesh;
+    mesh.baseVertex = GLint(vertices.size());
+
+    // Weld identical corners so the mesh can be indexed
+    std::map<std::array<float, 8>, GLuint> welded;
+    std::vector<GLuint> triangles;
+    triangles.reserve(positions.size());
+    glm::vec3 lower(std::numeric_limits<float>::max());
+    glm::vec3 upper(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        const glm::vec2 uv = i < uvs.size() ? uvs[i] : glm::vec2(0.f);
+        const glm::vec3 normal = i < normals.size() ? normals[i] : glm::vec3(0.f);
+        const std::array<float, 8> key = {{positions[i].x, positions[i].y, positions[i].z, uv.x, uv.y,
+                                           normal.x, normal.y, normal.z}};
+        auto found = welded.find(key);
+        if (found == welded.end()) {
+            found = welded.insert({key, GLuint(vertices.size()) - mesh.baseVertex}).first;
+            vertices.push_back({positions[i], uv, normal});
+            lower = glm::min(lower, positions[i]);
+            upper = glm::max(upper, positions[i]);
+        }
+        triangles.push_back(found->second);
+    }
+    const glm::vec3 extent = upper - lower;
+    const float side = std::max(extent.x, std::max(extent.y, extent.z));
+
+    for (int lod = 0; lod < lodCount; ++lod) {
+        std::vector<GLuint> lodIndices;
+        if (lodGrid[lod] == 0 || side <= 0.f) {
+            lodIndices = triangles;
+        } else {
+            // Every vertex moves to the first vertex of its grid cell, triangles that collapse are dropped
+            const float cell = side / lodGrid[lod] * 1.0001f;
+            std::map<std::array<int, 3>, GLuint> representatives;
+            std::vector<GLuint> remap(vertices.size() - mesh.baseVertex);
+            for (size_t v = 0; v < remap.size(); ++v) {
+                const glm::vec3 p = (vertices[mesh.baseVertex + v].position - lower) / cell;
+                const std::array<int, 3> key = {{int(p.x), int(p.y), int(p.z)}};
+                remap[v] = representatives.insert({key, GLuint(v)}).first->second;
+            }
+            for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+                const GLuint a = remap[triangles[t]];
+                const GLuint b = remap[triangles[t + 1]];
+                const GLuint c = remap[triangles[t + 2]];
+                if (a != b && b != c && a != c) {
+                    lodIndices.insert(lodIndices.end(), {a, b, c});
+                }
+            }
+            if (lodIndices.empty()) {
+                // Too coarse for this mesh, repeat the previous level
+                mesh.lods[lod] = mesh.lods[lod - 1];
+                continue;
+            }
+        }
+        mesh.lods[lod].firstIndex = GLuint(indices.size());
+        mesh.lods[lod].count = GLuint(lodIndices.size());
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+
+    meshes.push_back(mesh);
+    return int(meshes.size()) - 1;
+}
+
+int IndirectRenderer::addMaterial(GLuint texture) {
+    materials.push_back(texture);
+    return int(materials.size()) - 1;
+}
+
+void IndirectRenderer::finalize() {
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    // One entity index per instance, baseInstance selects the slice of each command
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, 0, (void*)0);
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The textures have different sizes, they are resampled to a common one
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layerSize, layerSize, GLsizei(std::max<size_t>(1, materials.size())),
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    std::vector<uint32_t> layer(size_t(layerSize) * layerSize);
+    for (size_t i = 0; i < materials.size(); ++i) {
+        const softrast::Texture source = readTexture(materials[i]);
+        for (int y = 0; y < layerSize; ++y) {
+            for (int x = 0; x < layerSize; ++x) {
+                layer[size_t(y) * layerSize + x] = source.sample((x + 0.5f) / layerSize, (y + 0.5f) / layerSize);
+            }
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), layerSize, layerSize, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                        layer.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void IndirectRenderer::reserve(GLenum target, GLuint buffer, size_t bytes, size_t& capacity, GLenum usage) {
+    glBindBuffer(target, buffer);
+    if (bytes > capacity) {
+        capacity = std::max(bytes, 2 * capacity);
+        glBufferData(target, capacity, nullptr, usage);
+    }
+}
+
+void IndirectRenderer::stream(GLenum target, GLuint buffer, const void* data, size_t bytes, size_t& capacity) {
+    glBindBuffer(target, buffer);
+    capacity = std::max(bytes, capacity);
+    glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, bytes, data);
+}
+
+void IndirectRenderer::begin() {
+    entities.clear();
+    meshEntityCount.assign(meshes.size(), 0);
+}
+
+void IndirectRenderer::add(const glm::vec3& position, float radius, int mesh, int material, bool visible) {
+    entities.push_back({glm::vec4(position, radius), GLuint(mesh), GLuint(material), GLuint(visible), 0});
+    ++meshEntityCount[mesh];
+}
+
+void IndirectRenderer::draw(const glm::mat4& view, const glm::mat4& projection,
+                            const lighting::TiledLightGrid* lights) {
+    if (entities.empty()) {
+        return;
+    }
+
+    // One command per mesh and level of detail, with room for every entity of the mesh.
+    // Uploading them also resets the instance counts the culling pass increments.
+    commands.clear();
+    GLuint instanceCount = 0;
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        for (const MeshLod& lod : meshes[m].lods) {
+            commands.push_back({lod.count, 0, lod.firstIndex, meshes[m].baseVertex, instanceCount});
+            instanceCount += meshEntityCount[m];
+        }
+    }
+    stream(GL_SHADER_STORAGE_BUFFER, entityBuffer, entities.data(), entities.size() * sizeof(Entity), entityCapacity);
+    stream(GL_SHADER_STORAGE_BUFFER, commandBuffer, commands.data(), commands.size() * sizeof(DrawCommand),
+           commandCapacity);
+    reserve(GL_SHADER_STORAGE_BUFFER, instanceBuffer, instanceCount * sizeof(GLuint), instanceCapacity,
+            GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Frustum planes (Gribb & Hartmann), pointing inwards and normalized
+    const glm::mat4 viewProjection = projection * view;
+    glm::vec4 planes[6];
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            glm::vec4& plane = planes[2 * axis + side];
+            for (int column = 0; column < 4; ++column) {
+                plane[column] = viewProjection[column][3] + (side == 0 ? 1.f : -1.f) * viewProjection[column][axis];
+            }
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+    const glm::vec3 cameraPosition(glm::inverse(view)[3]);
+
+    glUseProgram(cullProgram);
+    glUniform1ui(entityCountID, GLuint(entities.size()));
+    glUniform4fv(frustumPlanesID, 6, &planes[0][0]);
+    glUniform3fv(cameraPositionID, 1, &cameraPosition[0]);
+    glUniform1fv(lodScreenSizesID, lodCount - 1, lodScreenSizes);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, entityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, instanceBuffer);
+    glDispatchCompute(GLuint((entities.size() + 63) / 64), 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(drawProgram);
+    glUniformMatrix4fv(viewProjectionID, 1, GL_FALSE, &viewProjection[0][0]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+    glUniform1i(texturesID, 0);
+    glUniform1i(lightingEnabledID, lights != nullptr);
+    if (lights) {
+        lights->apply(lightUniforms);
+    }
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(commands.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    for (GLuint binding = 0; binding < 3; ++binding) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+}
+
+} // namespace gpudriven
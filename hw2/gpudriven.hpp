@@ -0,0 +1,128 @@
+#ifndef GPUDRIVEN_HPP
+#define GPUDRIVEN_HPP
+
+// GPU driven rendering of the textured entities (fireballs and targets).
+//
+// All meshes share one vertex and one index buffer, each with three levels of
+// detail built by vertex clustering, and all textures are resampled into the
+// layers of one texture array. Every frame the entities are uploaded to a
+// shader storage buffer as bounding spheres and CullComputeShader, one thread
+// per entity, tests them against the frustum, picks a level of detail from
+// their projected size and appends their index to the instance list of the
+// matching DrawElementsIndirectCommand. Everything is then submitted by a
+// single glMultiDrawElementsIndirect. The only visibility the CPU provides is
+// the occlusion culler's verdict, passed along with each entity.
+//
+// Needs GL 4.3 (compute shaders, SSBOs, multi draw indirect); see isSupported().
+// The per-Object draw loop in main.cpp stays as the fallback.
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "lighting.hpp"
+
+namespace gpudriven {
+
+class IndirectRenderer {
+public:
+    static constexpr int lodCount = 3;
+    static constexpr int layerSize = 512; // texture array resolution
+
+    static bool isSupported();
+
+    IndirectRenderer();
+    ~IndirectRenderer();
+
+    // Registration, before finalize(). Meshes are non-indexed triangle lists as
+    // returned by loadOBJ; materials are 2D textures that get copied.
+    int addMesh(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& uvs,
+                const std::vector<glm::vec3>& normals);
+    int addMaterial(GLuint texture);
+    // Uploads the geometry and the texture array
+    void finalize();
+
+    // Per frame: queue every entity, then draw them all
+    void begin();
+    // `visible` false drops the entity before the frustum test, e.g. when it is occluded
+    void add(const glm::vec3& position, float radius, int mesh, int material, bool visible = true);
+    // Unlit when `lights` is null
+    void draw(const glm::mat4& view, const glm::mat4& projection, const lighting::TiledLightGrid* lights);
+
+    size_t getEntityCount() const { return entities.size(); }
+
+private:
+    // std430 layouts shared with the shaders
+    struct Entity {
+        glm::vec4 sphere; // xyz = center, w = bounding radius
+        GLuint mesh;
+        GLuint material;
+        GLuint visible;
+        GLuint padding;
+    };
+
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+        glm::vec3 normal;
+    };
+
+    struct MeshLod {
+        GLuint firstIndex;
+        GLuint count;
+    };
+
+    struct Mesh {
+        GLint baseVertex;
+        MeshLod lods[lodCount];
+    };
+
+    // Buffers only grow. stream() orphans the storage before uploading so the CPU
+    // never waits for the previous frame to be done with it.
+    static void reserve(GLenum target, GLuint buffer, size_t bytes, size_t& capacity, GLenum usage);
+    static void stream(GLenum target, GLuint buffer, const void* data, size_t bytes, size_t& capacity);
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Mesh> meshes;
+    std::vector<GLuint> materials;
+
+    std::vector<Entity> entities;
+    std::vector<GLuint> meshEntityCount;
+    std::vector<DrawCommand> commands;
+
+    GLuint vertexArray = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint entityBuffer = 0;
+    GLuint commandBuffer = 0;
+    GLuint instanceBuffer = 0;
+    GLuint textureArray = 0;
+    size_t entityCapacity = 0;
+    size_t commandCapacity = 0;
+    size_t instanceCapacity = 0;
+
+    GLuint cullProgram;
+    GLint entityCountID;
+    GLint frustumPlanesID;
+    GLint cameraPositionID;
+    GLint lodScreenSizesID;
+
+    GLuint drawProgram;
+    GLint viewProjectionID;
+    GLint texturesID;
+    GLint lightingEnabledID;
+    lighting::Uniforms lightUniforms;
+};
+
+} // namespace gpudriven
+
+#endif // GPUDRIVEN_HPP
@@ -0,0 +1,124 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+// Event driven input and frame pacing for hw2.
+//
+// Mouse buttons are delivered by GLFW callbacks into a queue of timestamped
+// events instead of being polled once per frame, so a click that is pressed and
+// released within one frame is not lost. The simulation drains the queue.
+// FramePacer waits for the next frame slot inside the GLFW event loop before
+// input is sampled. LatencyStats collects click-to-photon times.
+//
+// Callbacks only run when events are pumped, so an event's timestamp is when
+// GLFW dispatched it, not when the button moved. The pacer pumps for its whole
+// wait and the frame polls again right before sampling input; clicks that
+// arrive while a frame is being simulated, drawn or swapped are stamped at the
+// next pump, so click-to-photon times are short by up to that long plus the
+// time spent in the OS queue.
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+#include "../scenegen/scenegen.hpp"
+
+namespace input {
+
+struct MouseEvent {
+    double time; // glfwGetTime() when the callback ran, see above
+    int button;
+    int action;
+};
+
+class EventQueue {
+public:
+    // Installs the callbacks; the window user pointer is taken by the queue
+    void attach(GLFWwindow* window) {
+        glfwSetWindowUserPointer(window, this);
+        glfwSetMouseButtonCallback(window, &EventQueue::mouseButtonCallback);
+    }
+
+    // Hands over the events received since the last call, oldest first
+    const std::vector<MouseEvent>& drain() {
+        drained.clear();
+        drained.swap(events);
+        return drained;
+    }
+
+private:
+    static void mouseButtonCallback(GLFWwindow* window, int button, int action, int /*mods*/) {
+        auto* queue = static_cast<EventQueue*>(glfwGetWindowUserPointer(window));
+        queue->events.push_back({glfwGetTime(), button, action});
+    }
+
+    std::vector<MouseEvent> events;
+    std::vector<MouseEvent> drained;
+};
+
+// Holds the loop to a fixed frame rate. Waiting happens at the start of the
+// frame so input is read as late as possible rather than right after a swap.
+class FramePacer {
+public:
+    explicit FramePacer(double fps) : period(fps > 0.0 ? 1.0 / fps : 0.0) {}
+
+    void wait() {
+        if (period <= 0.0) {
+            return;
+        }
+        const double now = glfwGetTime();
+        if (next == 0.0 || now > next + period) {
+            // First frame or fell behind by more than a frame: resynchronise instead of bursting
+            next = now;
+        }
+        // Wait in the event loop for the bulk of the wait so input is dispatched (and
+        // stamped) as it arrives, then spin the last millisecond for accuracy
+        while (next - glfwGetTime() > 0.002) {
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+            glfwWaitEventsTimeout(next - glfwGetTime() - 0.001);
+#else
+            // No timed wait before GLFW 3.2, sleep in short slices instead
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            glfwPollEvents();
+#endif
+        }
+        while (glfwGetTime() < next) {
+            glfwPollEvents();
+        }
+        next += period;
+    }
+
+private:
+    double period;
+    double next = 0.0;
+};
+
+class LatencyStats {
+public:
+    void add(double milliseconds) {
+        samples.push_back(milliseconds);
+    }
+
+    void print() const {
+        if (samples.empty()) {
+            printf("click-to-photon: no clicks measured\n");
+            return;
+        }
+        double sum = 0.0;
+        for (double sample : samples) {
+            sum += sample;
+        }
+        // Same percentiles as the frame times of scenegen::FrameTimer
+        printf("click-to-photon: %zu clicks, mean %.2f ms, p50 %.2f, p99 %.2f, max %.2f\n", samples.size(),
+               sum / samples.size(), scenegen::percentile(samples, 0.5), scenegen::percentile(samples, 0.99),
+               scenegen::percentile(samples, 1.0));
+    }
+
+private:
+    std::vector<double> samples;
+};
+
+} // namespace input
+
+#endif // INPUT_HPP
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cmath>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "lighting.hpp"
+#include "spherebounds.hpp"
+
+namespace lighting {
+
+Uniforms Uniforms::locate(GLuint program) {
+    Uniforms uniforms;
+    uniforms.lightTexture = glGetUniformLocation(program, "lightTexture");
+    uniforms.tileTexture = glGetUniformLocation(program, "tileTexture");
+    uniforms.indexTexture = glGetUniformLocation(program, "indexTexture");
+    uniforms.tileSize = glGetUniformLocation(program, "tileSize");
+    uniforms.tileCount = glGetUniformLocation(program, "tileCount");
+    uniforms.ambient = glGetUniformLocation(program, "ambient");
+    uniforms.sunDirection = glGetUniformLocation(program, "sunDirection");
+    return uniforms;
+}
+
+bool TiledLightGrid::isSupported() {
+    return GLEW_VERSION_3_0 || GLEW_ARB_texture_float;
+}
+
+static GLuint createFloatTexture(int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    // Lookup tables: exact texels only
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+TiledLightGrid::TiledLightGrid()
+        : rects(maxLights), lightTexels(2 * maxLights), indexTexels(indexCapacity) {
+    lightTexture = createFloatTexture(maxLights, 2);
+    indexTexture = createFloatTexture(indexTextureWidth, indexTextureHeight);
+    tileTexture = createFloatTexture(1, 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+TiledLightGrid::~TiledLightGrid() {
+    const GLuint textures[3] = {lightTexture, tileTexture, indexTexture};
+    glDeleteTextures(3, textures);
+}
+
+TiledLightGrid::TileRect TiledLightGrid::project(const PointLight& light, const glm::mat4& view,
+                                                 const glm::mat4& projection) const {
+    const TileRect empty = {0, 0, -1, -1};
+    const TileRect everything = {0, 0, tilesX - 1, tilesY - 1};
+    const glm::vec4 center = view * glm::vec4(light.position, 1.f);
+    const float depth = -center.z;
+    const float radius = light.radius;
+    if (depth + radius <= nearPlane) {
+        return empty;
+    }
+    if (depth - radius <= nearPlane) {
+        // The camera is inside or close to the sphere
+        return everything;
+    }
+
+    // The sphere lies between the lines through the eye tangent to it
+    float left, right, bottom, top;
+    sphereTangentRange(center.x, depth, radius, left, right);
+    sphereTangentRange(center.y, depth, radius, bottom, top);
+    left *= projection[0][0];
+    right *= projection[0][0];
+    bottom *= projection[1][1];
+    top *= projection[1][1];
+    if (right < -1.f || left > 1.f || top < -1.f || bottom > 1.f) {
+        return empty;
+    }
+
+    const float tilesPerUnitX = tilesX * 0.5f;
+    const float tilesPerUnitY = tilesY * 0.5f;
+    TileRect rect;
+    rect.x0 = std::max(0, int(std::floor((left + 1.f) * tilesPerUnitX)));
+    rect.x1 = std::min(tilesX - 1, int(std::floor((right + 1.f) * tilesPerUnitX)));
+    rect.y0 = std::max(0, int(std::floor((bottom + 1.f) * tilesPerUnitY)));
+    rect.y1 = std::min(tilesY - 1, int(std::floor((top + 1.f) * tilesPerUnitY)));
+    return rect;
+}
+
+void TiledLightGrid::update(const std::vector<PointLight>& lights, const glm::mat4& view,
+                            const glm::mat4& projection, int width, int height) {
+    const int newTilesX = (width + tileSize - 1) / tileSize;
+    const int newTilesY = (height + tileSize - 1) / tileSize;
+    if (newTilesX != tilesX || newTilesY != tilesY) {
+        tilesX = newTilesX;
+        tilesY = newTilesY;
+        tileCounts.assign(size_t(tilesX) * tilesY, 0);
+        tileTexels.assign(size_t(tilesX) * tilesY, glm::vec4(0.f));
+        glBindTexture(GL_TEXTURE_2D, tileTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tilesX, tilesY, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    // glm::perspective: [2][2] = -(f + n) / (f - n), [3][2] = -2fn / (f - n)
+    nearPlane = projection[3][2] / (projection[2][2] - 1.f);
+
+    // Pass 1: screen rectangle of every light and the number of lights per tile
+    lightCount = int(std::min<size_t>(lights.size(), maxLights));
+    std::fill(tileCounts.begin(), tileCounts.end(), 0);
+    for (int i = 0; i < lightCount; ++i) {
+        const PointLight& light = lights[i];
+        lightTexels[i] = glm::vec4(light.position, light.radius);
+        lightTexels[maxLights + i] = glm::vec4(light.color, 0.f);
+        rects[i] = project(light, view, projection);
+        for (int y = rects[i].y0; y <= rects[i].y1; ++y) {
+            for (int x = rects[i].x0; x <= rects[i].x1; ++x) {
+                ++tileCounts[size_t(y) * tilesX + x];
+            }
+        }
+    }
+
+    // Lists are laid out back to back. Crowded tiles keep their first
+    // maxLightsPerTile lights and the lists stop when the index texture is full.
+    binnedCount = 0;
+    for (size_t tile = 0; tile < tileCounts.size(); ++tile) {
+        const int count = std::min(std::min(tileCounts[tile], int(maxLightsPerTile)), indexCapacity - binnedCount);
+        tileTexels[tile] = glm::vec4(float(binnedCount), float(count), 0.f, 0.f);
+        binnedCount += count;
+        tileCounts[tile] = 0;
+    }
+
+    // Pass 2: fill the lists, tileCounts now counts what was written
+    for (int i = 0; i < lightCount; ++i) {
+        for (int y = rects[i].y0; y <= rects[i].y1; ++y) {
+            for (int x = rects[i].x0; x <= rects[i].x1; ++x) {
+                const size_t tile = size_t(y) * tilesX + x;
+                if (tileCounts[tile] < int(tileTexels[tile].y)) {
+                    indexTexels[size_t(tileTexels[tile].x) + tileCounts[tile]++] = float(i);
+                }
+            }
+        }
+    }
+
+    if (lightCount > 0) {
+        glBindTexture(GL_TEXTURE_2D, lightTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, lightCount, 1, GL_RGBA, GL_FLOAT, &lightTexels[0]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 1, lightCount, 1, GL_RGBA, GL_FLOAT, &lightTexels[maxLights]);
+    }
+    glBindTexture(GL_TEXTURE_2D, tileTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tilesX, tilesY, GL_RGBA, GL_FLOAT, &tileTexels[0]);
+    if (binnedCount > 0) {
+        const int rows = (binnedCount + 4 * indexTextureWidth - 1) / (4 * indexTextureWidth);
+        glBindTexture(GL_TEXTURE_2D, indexTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indexTextureWidth, rows, GL_RGBA, GL_FLOAT, &indexTexels[0]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TiledLightGrid::apply(const Uniforms& uniforms) const {
+    const GLuint textures[3] = {lightTexture, tileTexture, indexTexture};
+    const GLint samplers[3] = {uniforms.lightTexture, uniforms.tileTexture, uniforms.indexTexture};
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + firstTextureUnit + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glUniform1i(samplers[i], firstTextureUnit + i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1f(uniforms.tileSize, float(tileSize));
+    glUniform2f(uniforms.tileCount, float(tilesX), float(tilesY));
+    glUniform1f(uniforms.ambient, 0.45f);
+    const glm::vec3 sun = glm::normalize(glm::vec3(0.3f, 1.f, 0.2f));
+    glUniform3f(uniforms.sunDirection, sun.x, sun.y, sun.z);
+}
+
+} // namespace lighting
@@ -0,0 +1,98 @@
+#ifndef LIGHTING_HPP
+#define LIGHTING_HPP
+
+// Tiled forward lighting with many point lights.
+//
+// The screen is cut into tileSize x tileSize pixel tiles. Every frame each
+// light's sphere of influence is projected to a conservative screen rectangle
+// and the light is appended to the list of every tile it touches. The lists are
+// stored back to back (first index and count per tile) and uploaded to three
+// float textures together with the light parameters:
+//     lightTexture : maxLights x 2, row 0 = position + radius, row 1 = color
+//     tileTexture  : one texel per tile, x = first list entry, y = count
+//     indexTexture : the lists, four light indices per texel
+// The fragment shaders look up their tile with gl_FragCoord and only loop over
+// that tile's lights, so the per-fragment cost follows the local light density
+// rather than the total light count. Float textures are read with texture2D so
+// GLSL 1.20 works as well.
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace lighting {
+
+struct PointLight {
+    glm::vec3 position;
+    float radius;      // no contribution beyond this distance
+    glm::vec3 color;
+};
+
+// Uniform locations of a program that contains the lighting code
+struct Uniforms {
+    GLint lightTexture = -1;
+    GLint tileTexture = -1;
+    GLint indexTexture = -1;
+    GLint tileSize = -1;
+    GLint tileCount = -1;
+    GLint ambient = -1;
+    GLint sunDirection = -1;
+
+    static Uniforms locate(GLuint program);
+};
+
+class TiledLightGrid {
+public:
+    static constexpr int tileSize = 32;
+    static constexpr int maxLights = 1024;
+    static constexpr int maxLightsPerTile = 64;  // must match the fragment shaders
+    static constexpr int indexTextureWidth = 1024;
+    static constexpr int indexTextureHeight = 16;
+    static constexpr int indexCapacity = indexTextureWidth * indexTextureHeight * 4;
+    static constexpr int firstTextureUnit = 1;  // unit 0 is the material texture
+
+    // Needs float textures (GL 3.0 or ARB_texture_float)
+    static bool isSupported();
+
+    TiledLightGrid();
+    ~TiledLightGrid();
+
+    // Bins the lights into the tiles of a width x height viewport and uploads everything.
+    // Lights past maxLights are ignored.
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                int width, int height);
+
+    // Binds the textures and sets the uniforms of the current program
+    void apply(const Uniforms& uniforms) const;
+
+    int getLightCount() const { return lightCount; }
+    // Sum of all tile list lengths, what the fragment shaders loop over at most
+    int getBinnedCount() const { return binnedCount; }
+
+private:
+    struct TileRect {
+        int x0, y0, x1, y1; // inclusive, empty when x0 > x1
+    };
+
+    TileRect project(const PointLight& light, const glm::mat4& view, const glm::mat4& projection) const;
+
+    GLuint lightTexture;
+    GLuint tileTexture;
+    GLuint indexTexture;
+
+    int tilesX = 0;
+    int tilesY = 0;
+    int lightCount = 0;
+    int binnedCount = 0;
+    float nearPlane = 0.1f;
+
+    std::vector<TileRect> rects;
+    std::vector<int> tileCounts;
+    std::vector<glm::vec4> lightTexels;
+    std::vector<glm::vec4> tileTexels;
+    std::vector<float> indexTexels;
+};
+
+} // namespace lighting
+
+#endif // LIGHTING_HPP
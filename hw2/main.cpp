@@ -1,7 +1,12 @@
 // Include standard headers
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include <vector>
+#include <string>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -20,6 +25,25 @@ using namespace glm;
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <iostream>
+#include <cstring>
+
+#include "softrast.hpp"
+#include "occlusion.hpp"
+#include "input.hpp"
+#include "targetpool.hpp"
+#include "particles.hpp"
+#include "lighting.hpp"
+#include "gpudriven.hpp"
+#include "dynres.hpp"
+#include "../scenegen/scenegen.hpp"
+
+// Must come after every GL/GLFW header: redirects GL calls through the capture layer
+#include "gltrace.hpp"
+
+// Set by --backend soft: every Object is rendered on the CPU and the frame is blitted with glDrawPixels
+softrast::Rasterizer* softRasterizer = nullptr;
+// Fireball point lights binned into screen tiles; null leaves every Object unlit
+lighting::TiledLightGrid* lightGrid = nullptr;
 
 int initializeContext() {
     // Initialise GLFW
@@ -96,6 +120,9 @@ struct Object{
     GLuint MatrixID;
     GLuint VertexPositionModelspaceID;
     GLuint VertexUVID;
+    GLint VertexNormalModelspaceID;
+    GLuint ModelMatrixID;
+    GLuint LightingEnabledID;
     GLuint Texture;
     GLuint TextureID;
 
@@ -105,20 +132,66 @@ struct Object{
 
     GLuint vertexbuffer;
     GLuint uvbuffer;
+    GLuint normalbuffer;
+
+    // Lit by lightGrid when there is one, the crosshair is not
+    bool lit = true;
+    lighting::Uniforms lightUniforms;
+
+    // Spheres around the model origin: smallest one containing the mesh and
+    // largest one contained in it (exact for convex meshes such as ours)
+    float boundingRadius = 0.f;
+    float innerRadius = 0.f;
+
+    softrast::Texture softTexture;
+
+    // Handles in the GPU driven renderer, when it is used
+    int indirectMesh = -1;
+    int indirectMaterial = -1;
 
     explicit Object(const char* imagePath, bool isDDS = true) {
         Id = LoadShaders("TransformVertexShader.vertexshader", "TextureFragmentShader.fragmentshader");
         MatrixID = glGetUniformLocation(Id, "MVP");
         VertexPositionModelspaceID = glGetAttribLocation(Id, "vertexPosition_modelspace");
         VertexUVID = glGetAttribLocation(Id, "vertexUV"); //!!!
+        VertexNormalModelspaceID = glGetAttribLocation(Id, "vertexNormal_modelspace");
+        ModelMatrixID = glGetUniformLocation(Id, "M");
+        LightingEnabledID = glGetUniformLocation(Id, "lightingEnabled");
+        lightUniforms = lighting::Uniforms::locate(Id);
         // Load the texture
         Texture = isDDS ? loadDDS(imagePath) : loadBMP_custom(imagePath);
         // Get a handle for our "myTextureSampler" uniform
         TextureID  = glGetUniformLocation(Id, "myTextureSampler");
+        if (softRasterizer) {
+            softTexture = isDDS ? softrast::Texture::loadDDS(imagePath) : softrast::Texture::loadBMP(imagePath);
+        }
     }
 
     void load(const char * pathToObj) {
         loadOBJ(pathToObj, vertices, uvs, normals);
+        upload();
+    }
+
+    void load(const scenegen::Mesh& mesh) {
+        vertices = mesh.vertices;
+        uvs = mesh.uvs;
+        normals = mesh.normals;
+        upload();
+    }
+
+    void upload() {
+        boundingRadius = 0.f;
+        innerRadius = vertices.empty() ? 0.f : std::numeric_limits<float>::max();
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+            const glm::vec3 normal = glm::cross(vertices[i + 1] - vertices[i], vertices[i + 2] - vertices[i]);
+            const float length = glm::length(normal);
+            if (length > 0.f) {
+                innerRadius = std::min(innerRadius, std::fabs(glm::dot(normal / length, vertices[i])));
+            }
+        }
+        for (const auto& vertex : vertices) {
+            boundingRadius = std::max(boundingRadius, glm::length(vertex));
+        }
 
         glGenBuffers(1, &vertexbuffer);
         glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
@@ -127,19 +200,44 @@ struct Object{
         glGenBuffers(1, &uvbuffer);
         glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
         glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+
+        // Meshes exported without normals get flat ones
+        if (normals.size() != vertices.size()) {
+            normals.assign(vertices.size(), glm::vec3(0.f, 0.f, 1.f));
+            for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+                const glm::vec3 normal = glm::cross(vertices[i + 1] - vertices[i], vertices[i + 2] - vertices[i]);
+                if (glm::length(normal) > 0.f) {
+                    normals[i] = normals[i + 1] = normals[i + 2] = glm::normalize(normal);
+                }
+            }
+        }
+        glGenBuffers(1, &normalbuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
     }
 
     size_t getVerticesSize() const {
         return vertices.size();
     }
 
-    void draw() {
+    void draw(const glm::mat4& MVP, const glm::mat4& ModelMatrix) {
+        if (softRasterizer) {
+            softRasterizer->drawTextured(vertices, uvs, MVP, &softTexture);
+            return;
+        }
+
         // Bind our texture in Texture Unit 0
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, Texture);
         // Set our "myTextureSampler" sampler to use Texture Unit 0
         glUniform1i(TextureID, 0);
 
+        glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
+        glUniform1i(LightingEnabledID, lightGrid && lit);
+        if (lightGrid && lit) {
+            lightGrid->apply(lightUniforms);
+        }
+
         // 1rst attribute buffer : vertices
         glEnableVertexAttribArray(VertexPositionModelspaceID);
         glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
@@ -164,11 +262,21 @@ struct Object{
                 (void*)0                          // array buffer offset
         );
 
+        // 3rd attribute buffer : normals
+        if (VertexNormalModelspaceID >= 0) {
+            glEnableVertexAttribArray(VertexNormalModelspaceID);
+            glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+            glVertexAttribPointer(VertexNormalModelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        }
+
         // Draw the triangle !
         glDrawArrays(GL_TRIANGLES, 0, getVerticesSize()); // 12*3 indices starting at 0 -> 12 triangles
 
         glDisableVertexAttribArray(VertexPositionModelspaceID);
         glDisableVertexAttribArray(VertexUVID);
+        if (VertexNormalModelspaceID >= 0) {
+            glDisableVertexAttribArray(VertexNormalModelspaceID);
+        }
     }
 
 
@@ -178,6 +286,7 @@ struct Object{
         glDeleteTextures(1, &TextureID);
         glDeleteBuffers(1, &vertexbuffer);
         glDeleteBuffers(1, &uvbuffer);
+        glDeleteBuffers(1, &normalbuffer);
     }
 };
 
@@ -197,15 +306,123 @@ void calculatePosition(GLuint objId, const glm::vec3& position, GLuint matrixID,
     glUniformMatrix4fv(matrixID, 1, GL_FALSE, &MVP[0][0]);
 }
 
+void presentSoftFrame() {
+    const auto& pixels = softRasterizer->flush();
+    glUseProgram(0);
+    glDisable(GL_DEPTH_TEST);
+    glWindowPos2i(0, 0);
+    glDrawPixels(softRasterizer->getWidth(), softRasterizer->getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glEnable(GL_DEPTH_TEST);
+}
+
 int getSign() {
     return ((std::rand() % 2) == 0) ? 1 : -1;
 }
 
-int main( void )
+int main(int argc, char* argv[])
 {
+    // --capture <file> : record the GL calls of the session into a trace for gltrace_replay,
+    //                    features whose calls are not recorded are turned off meanwhile
+    // --backend gl|soft  : render through OpenGL (default) or the CPU rasterizer
+    // --threads <n>      : threads rasterizing on the CPU, the main one included, 0 = one per core
+    // --scene <spec>    : start from a generated target field, see scenegen.hpp
+    constexpr float targetRadius = 3.f;
+    constexpr int minTargetDistance = 5;
+    constexpr int maxTargetDistance = 30;
+
+    scenegen::Options options;
+    options.params.innerRadius = minTargetDistance;
+    options.params.extent = maxTargetDistance;
+    if (!scenegen::parseOptions(argc, argv, options)) {
+        return -1;
+    }
+
+    // --no-occlusion     : draw every entity, even those hidden behind the nearest targets
+    // --swap-interval <n>: vsync interval passed to glfwSwapInterval
+    // --fps <f>          : pace the loop to f frames per second, input is sampled after the wait
+    // --measure-latency  : glFinish after frames that show a new shot and report click-to-photon times
+    // --particles <n>    : size of the GPU fireball trail pool, 0 disables the trails
+    // --no-gpu-driven    : keep culling and draw submission on the CPU even when GL 4.3 is available
+    // --no-lighting      : draw the textures unlit instead of lighting them with the fireballs
+    // --max-targets <n>  : live target cap, a spawn beyond it replaces the farthest target
+    // --target-frame-ms <ms>   : GPU frame time the dynamic resolution controller holds
+    // --no-dynamic-resolution  : always render at window resolution with 4x MSAA
+    bool softBackend = false;
+    unsigned softThreads = 0;
+    bool occlusionCulling = true;
+    int swapInterval = -1;
+    double targetFps = 0.0;
+    bool measureLatency = false;
+    size_t particleCount = 131072;
+    bool gpuDriven = true;
+    bool lightingEnabled = true;
+    size_t maxTargets = 64;
+    bool dynamicResolutionEnabled = true;
+    double targetFrameMilliseconds = 1000.0 / 60.0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            gltrace::begin(argv[++i]);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            softBackend = strcmp(argv[++i], "soft") == 0;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            softThreads = unsigned(std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--no-occlusion") == 0) {
+            occlusionCulling = false;
+        } else if (strcmp(argv[i], "--swap-interval") == 0 && i + 1 < argc) {
+            swapInterval = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            targetFps = std::atof(argv[++i]);
+        } else if (strcmp(argv[i], "--measure-latency") == 0) {
+            measureLatency = true;
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            particleCount = size_t(std::max(0, std::atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--no-gpu-driven") == 0) {
+            gpuDriven = false;
+        } else if (strcmp(argv[i], "--no-lighting") == 0) {
+            lightingEnabled = false;
+        } else if (strcmp(argv[i], "--max-targets") == 0 && i + 1 < argc) {
+            maxTargets = size_t(std::max(1, std::atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--target-frame-ms") == 0 && i + 1 < argc) {
+            targetFrameMilliseconds = std::atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-dynamic-resolution") == 0) {
+            dynamicResolutionEnabled = false;
+        }
+    }
+
+    // Only the calls wrapped by gltrace.hpp are recorded. Paths built on anything else are
+    // turned off while capturing, a trace of them would not reproduce the frame.
+    if (gltrace::capturing()) {
+        if (particleCount > 0) {
+            fprintf(stderr, "Transform feedback is not captured, fireball trails are disabled\n");
+            particleCount = 0;
+        }
+        if (gpuDriven) {
+            fprintf(stderr, "Compute dispatches and indirect draws are not captured, GPU-driven rendering is disabled\n");
+            gpuDriven = false;
+        }
+        if (lightingEnabled) {
+            fprintf(stderr, "Light grid textures are not captured, lighting is disabled\n");
+            lightingEnabled = false;
+        }
+        if (dynamicResolutionEnabled) {
+            fprintf(stderr, "Framebuffer blits and timer queries are not captured, dynamic resolution is disabled\n");
+            dynamicResolutionEnabled = false;
+        }
+    }
+
 	// Initialise GLFW
 	initializeContext();
 
+    if (softBackend) {
+        softRasterizer = new softrast::Rasterizer(1024, 768, softThreads);
+    }
+    // Do not let vsync cap the measured frame times
+    if (options.benchFrames > 0) {
+        glfwSwapInterval(0);
+    } else if (swapInterval >= 0) {
+        glfwSwapInterval(swapInterval);
+    }
+
 	Object fireballObj("images/virus.bmp", false);
     Object targetEarthObj("images/earthmap.bmp", false);
     Object targetMarsObj("images/Mars.bmp", false);
@@ -215,67 +432,313 @@ int main( void )
     targetEarthObj.load("objects/target.obj");
     targetMarsObj.load("objects/target.obj");
     crossHairObj.load("objects/crosshair.obj");
+    crossHairObj.lit = false;
+
+    // Every fireball is a point light. The CPU backend stays unlit.
+    constexpr float fireballLightRadius = 8.f;
+    const glm::vec3 fireballLightColor(1.6f, 0.8f, 0.3f);
+    if (lightingEnabled && !softRasterizer) {
+        if (lighting::TiledLightGrid::isSupported()) {
+            lightGrid = new lighting::TiledLightGrid();
+        } else {
+            fprintf(stderr, "Float textures are not available, lighting is disabled\n");
+        }
+    }
+    std::vector<lighting::PointLight> lights;
+
+    // The scene goes through an offscreen framebuffer sized to hold the target frame time, the
+    // crosshair is drawn on top at window resolution. Benchmarks measure a fixed amount of work.
+    std::unique_ptr<dynres::DynamicResolution> dynamicResolution;
+    if (dynamicResolutionEnabled && !softRasterizer && options.benchFrames == 0) {
+        if (dynres::DynamicResolution::isSupported()) {
+            dynamicResolution.reset(new dynres::DynamicResolution(1024, 768, targetFrameMilliseconds));
+        } else {
+            fprintf(stderr, "Framebuffer objects or timer queries are not available, dynamic resolution is disabled\n");
+        }
+    }
 
-    constexpr float targetRadius = 3.f;
-    constexpr int minTargetDistance = 5;
-    constexpr int maxTargetDistance = 30;
+    // Trails are simulated with transform feedback, which the CPU backend has no equivalent for
+    std::unique_ptr<ParticleSystem> particles;
+    if (particleCount > 0 && !softRasterizer) {
+        if (ParticleSystem::isSupported()) {
+            particles.reset(new ParticleSystem(particleCount));
+        } else {
+            fprintf(stderr, "GL 3.0 is not available, fireball trails are disabled\n");
+        }
+    }
+    std::vector<glm::vec3> emitterPositions;
+    std::vector<glm::vec3> emitterSteps;
 
     int mouseState = GLFW_RELEASE;
+    input::EventQueue inputQueue;
+    inputQueue.attach(window);
+    input::FramePacer framePacer(targetFps);
+    input::LatencyStats latencyStats;
+    std::vector<double> pendingClicks;
 
     float lastSpawnTime = 0.f;
 
     std::vector<Fireball> fireballs;
-    std::vector<std::pair<glm::vec3, size_t>> targets;
-    size_t targets_number = 0;
+
+    // A generated scene brings its own sphere mesh and one Object (program + texture) per material
+    std::vector<std::unique_ptr<Object>> sceneMaterials;
+    // Targets are retired when they drift out of play: behind the player and farther than a spawn
+    // (or the generated scene) reaches from the origin, or anywhere beyond twice that. Spawns stay
+    // around the origin, so from the starting position no target is retired as soon as it appears.
+    // A generated scene raises the cap to hold all its spheres.
+    scenegen::Scene scene;
+    float targetReach = maxTargetDistance * std::sqrt(3.f);
+    if (options.hasScene) {
+        scene = scenegen::generate(options.params);
+        maxTargets = std::max(maxTargets, size_t(options.params.spheres));
+        for (const auto& sphere : scene.spheres) {
+            targetReach = std::max(targetReach, glm::distance(sphere.position, getPosition()));
+        }
+    }
+    TargetPool targets(maxTargets, 2.f * targetReach, targetReach);
+    if (options.hasScene) {
+        const std::pair<const char*, bool> images[] = {
+            {"images/earthmap.bmp", false}, {"images/virus.bmp", false},
+            {"images/uvtemplate.DDS", true}, {"images/fire.DDS", true}, {"images/target.DDS", true}
+        };
+        for (int material = 0; material < scene.params.materials; ++material) {
+            const auto& image = images[material % (sizeof(images) / sizeof(images[0]))];
+            sceneMaterials.emplace_back(new Object(image.first, image.second));
+            sceneMaterials.back()->load(scene.sphere);
+        }
+        for (const auto& sphere : scene.spheres) {
+            targets.spawn(sphere.position, getPosition());
+        }
+        for (const auto& projectile : scene.projectiles) {
+            fireballs.push_back({projectile.position, glm::normalize(projectile.velocity)});
+        }
+    }
+    // Generated spheres are hit at their own radius, spawned targets at the target model's
+    const float hitRadius = options.hasScene ? scene.params.radius : targetRadius;
+    // A benchmarked scene stays as generated: nothing spawns and nothing is shot down
+    const bool frozenScene = options.hasScene && options.benchFrames > 0;
+    scenegen::FrameTimer frameTimer(options.benchFrames);
+
+    // Fireballs and targets are culled and submitted by the GPU when it can do it,
+    // the per-Object loop below remains for GL 2.1 and the soft backend
+    std::unique_ptr<gpudriven::IndirectRenderer> indirectRenderer;
+    if (gpuDriven && !softRasterizer && gpudriven::IndirectRenderer::isSupported()) {
+        indirectRenderer.reset(new gpudriven::IndirectRenderer());
+        std::vector<Object*> entityObjects = {&fireballObj, &targetEarthObj, &targetMarsObj};
+        for (auto& material : sceneMaterials) {
+            entityObjects.push_back(material.get());
+        }
+        for (Object* obj : entityObjects) {
+            obj->indirectMesh = indirectRenderer->addMesh(obj->vertices, obj->uvs, obj->normals);
+            obj->indirectMaterial = indirectRenderer->addMaterial(obj->Texture);
+        }
+        indirectRenderer->finalize();
+    }
+
+    // Only the nearest targets are worth rasterizing as occluders
+    constexpr size_t maxOccluders = 16;
+    occlusion::OcclusionCuller occlusionCuller;
+    std::vector<glm::vec4> occluders;
+    std::string lastTitle;
+
+    double lastFrameTime = glfwGetTime();
 
 	do {
+        // Wait for the frame slot first, so everything below sees the freshest input
+        framePacer.wait();
 
-		// Clear the screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		const auto currTime = glfwGetTime();
+        const float deltaTime = float(currTime - lastFrameTime);
+        lastFrameTime = currTime;
+
+        ////////////////////////////////////////////////////////////////////////////
+        ////////////////////////      Simulation      //////////////////////////////
+        ////////////////////////////////////////////////////////////////////////////
+        for (auto& fireball: fireballs) {
+            fireball.position += fireball.direction * float(Fireball::speed);
+        }
 
-		// Compute the MVP matrix from keyboard and mouse input
+        // Benchmark runs keep their scene as generated
+        if (options.benchFrames == 0) {
+            targets.retire(getPosition(), getDirection());
+        }
+        if (!frozenScene && (targets.empty() || (currTime - lastSpawnTime > 2.f))) {
+            targets.spawn({
+                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance),
+                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance),
+                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance)
+            }, getPosition());
+            lastSpawnTime = currTime;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        ////////////////////////      Collider        //////////////////////////////
+        ////////////////////////////////////////////////////////////////////////////
+        fireballs.erase(std::remove_if(fireballs.begin(), fireballs.end(), [&](const Fireball& fireball) {
+            return glm::distance(fireball.position, getPosition()) > 2 * maxTargetDistance;
+        }), fireballs.end());
+
+        for (size_t target_idx = 0; target_idx < targets.size();) {
+            bool hit = false;
+            for (size_t fireball_idx = 0; !frozenScene && fireball_idx < fireballs.size(); ++fireball_idx) {
+                if (glm::distance(targets[target_idx].position, fireballs[fireball_idx].position) < Fireball::radius + hitRadius) {
+                    fireballs.erase(fireballs.begin() + fireball_idx);
+                    hit = true;
+                    break;
+                }
+            }
+            if (hit) {
+                // Another live target took this slot, look at it again
+                targets.hit(target_idx);
+                continue;
+            }
+            // Benchmark runs are not supposed to end early
+            if (options.benchFrames == 0 && glm::distance(targets[target_idx].position, getPosition()) < hitRadius) {
+                std::cout << "You lose!" << std::endl;
+                targets.print();
+                gltrace::end();
+                return 0;
+            }
+            ++target_idx;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        ////////////////////////      Input           //////////////////////////////
+        ////////////////////////////////////////////////////////////////////////////
+        // Late latch: the camera is sampled right before submission, not at the top of the frame
+		glfwPollEvents();
 		computeMatricesFromInputs();
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
 		glm::mat4 ModelMatrix = glm::mat4(1.0);
 		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
-		const auto currTime = glfwGetTime();
+        // A shot is a press followed by a release, even when both arrived during the same frame
+        for (const auto& event : inputQueue.drain()) {
+            if (event.button != GLFW_MOUSE_BUTTON_LEFT) {
+                continue;
+            }
+            if (event.action == GLFW_PRESS) {
+                mouseState = GLFW_PRESS;
+            } else if (event.action == GLFW_RELEASE && mouseState == GLFW_PRESS) {
+                mouseState = GLFW_RELEASE;
+                fireballs.push_back({getPosition() + getDirection() * float(Fireball::startDistance), getDirection()});
+                pendingClicks.push_back(event.time);
+            }
+        }
+
+		// Everything up to the crosshair is drawn at the render resolution
+		if (dynamicResolution) {
+		    dynamicResolution->begin();
+		}
+		const int renderWidth = dynamicResolution ? dynamicResolution->getWidth() : 1024;
+		const int renderHeight = dynamicResolution ? dynamicResolution->getHeight() : 768;
+
+		// Clear the screen
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (softRasterizer) {
+		    softRasterizer->clear(glm::vec4(0.4f, 0.5f, 1.f, 0.0f));
+		}
+
+        auto targetObject = [&](size_t id) -> Object& {
+            return !sceneMaterials.empty() ? *sceneMaterials[id % sceneMaterials.size()]
+                 : (id % 2 == 0) ? targetMarsObj : targetEarthObj;
+        };
+
+        // The newest fireballs win when there are more than the grid holds
+        if (lightGrid) {
+            lights.clear();
+            const size_t firstLight = fireballs.size() - std::min<size_t>(fireballs.size(), lighting::TiledLightGrid::maxLights);
+            for (size_t i = firstLight; i < fireballs.size(); ++i) {
+                lights.push_back({fireballs[i].position, fireballLightRadius, fireballLightColor});
+            }
+            lightGrid->update(lights, ViewMatrix, ProjectionMatrix, renderWidth, renderHeight);
+        }
+
+        occlusionCuller.begin(ViewMatrix, ProjectionMatrix);
+        if (occlusionCulling) {
+            occluders.clear();
+            for (const auto& target : targets) {
+                occluders.push_back(glm::vec4(target.position, targetObject(target.id).innerRadius));
+            }
+            occlusionCuller.addOccluders(occluders, maxOccluders);
+        }
+        auto isVisible = [&](const glm::vec3& position, const Object& obj) {
+            return !occlusionCulling || occlusionCuller.isVisible(position, obj.boundingRadius);
+        };
 
         ////////////////////////////////////////////////////////////////////////////
-        ////////////////////////      Fireball        //////////////////////////////
+        ////////////////////////      GPU driven      //////////////////////////////
         ////////////////////////////////////////////////////////////////////////////
-        glUseProgram(fireballObj.Id);
-        int newState = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-        if (newState == GLFW_RELEASE && mouseState == GLFW_PRESS) {
-            fireballs.push_back({getPosition() + getDirection() * float(Fireball::startDistance), getDirection()});
+        if (indirectRenderer) {
+            indirectRenderer->begin();
+            for (const auto& fireball : fireballs) {
+                indirectRenderer->add(fireball.position, fireballObj.boundingRadius, fireballObj.indirectMesh,
+                                      fireballObj.indirectMaterial, isVisible(fireball.position, fireballObj));
+            }
+            for (const auto& target : targets) {
+                const Object& obj = targetObject(target.id);
+                indirectRenderer->add(target.position, obj.boundingRadius, obj.indirectMesh, obj.indirectMaterial,
+                                      isVisible(target.position, obj));
+            }
+            indirectRenderer->draw(ViewMatrix, ProjectionMatrix, lightGrid);
         }
-        mouseState = newState;
 
-        for (auto& fireball: fireballs) {
-            calculatePosition(fireballObj.Id, fireball.position, fireballObj.MatrixID, ModelMatrix, MVP,
-                              ProjectionMatrix, ViewMatrix);
-            fireballObj.draw();
-            fireball.position += fireball.direction * float(Fireball::speed);
+        ////////////////////////////////////////////////////////////////////////////
+        ////////////////////////      Fireball        //////////////////////////////
+        ////////////////////////////////////////////////////////////////////////////
+        if (!indirectRenderer) {
+            glUseProgram(fireballObj.Id);
+            for (const auto& fireball: fireballs) {
+                if (isVisible(fireball.position, fireballObj)) {
+                    calculatePosition(fireballObj.Id, fireball.position, fireballObj.MatrixID, ModelMatrix, MVP,
+                                      ProjectionMatrix, ViewMatrix);
+                    fireballObj.draw(MVP, ModelMatrix);
+                }
+            }
         }
 
         ////////////////////////////////////////////////////////////////////////////
         ////////////////////////      Targets         //////////////////////////////
         ////////////////////////////////////////////////////////////////////////////
-        if (targets.empty() || (currTime - lastSpawnTime > 2.f)) {
-            targets.push_back({{
-                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance),
-                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance),
-                getSign() * (std::rand() % (maxTargetDistance - minTargetDistance) + minTargetDistance)
-            }, targets_number++});
-            lastSpawnTime = currTime;
+        if (!indirectRenderer) {
+            for (const auto& target : targets) {
+                auto& obj = targetObject(target.id);
+                if (!isVisible(target.position, obj)) {
+                    continue;
+                }
+                glUseProgram(obj.Id);
+                calculatePosition(obj.Id, target.position, obj.MatrixID, ModelMatrix, MVP, ProjectionMatrix, ViewMatrix);
+                obj.draw(MVP, ModelMatrix);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        ////////////////////////      Trails          //////////////////////////////
+        ////////////////////////////////////////////////////////////////////////////
+        if (particles) {
+            emitterPositions.clear();
+            emitterSteps.clear();
+            for (const auto& fireball : fireballs) {
+                emitterPositions.push_back(fireball.position);
+                emitterSteps.push_back(fireball.direction * float(Fireball::speed));
+            }
+            particles->update(emitterPositions, emitterSteps, deltaTime);
+            particles->draw(ProjectionMatrix * ViewMatrix, ProjectionMatrix, renderHeight);
         }
 
-        for (const auto& target : targets) {
-            auto& obj = (target.second % 2 == 0) ? targetMarsObj : targetEarthObj;
-            glUseProgram(obj.Id);
-            calculatePosition(obj.Id, target.first, obj.MatrixID, ModelMatrix, MVP, ProjectionMatrix, ViewMatrix);
-            obj.draw();
+        if (dynamicResolution) {
+            dynamicResolution->end();
+        }
+
+        // Per frame report, the title is only touched when the numbers change
+        char title[192];
+        snprintf(title, sizeof(title), "Tutorial 0 - Keyboard and Mouse - occluded %d / %d - targets %zu - %dx%d %dx",
+                 occlusionCuller.occluded(), occlusionCuller.tested(), targets.size(), renderWidth, renderHeight,
+                 dynamicResolution ? dynamicResolution->getSamples() : 4);
+        if (lastTitle != title) {
+            lastTitle = title;
+            glfwSetWindowTitle(window, title);
         }
 
         ////////////////////////////////////////////////////////////////////////////
@@ -285,34 +748,54 @@ int main( void )
         glUseProgram(crossHairObj.Id);
         calculatePosition(crossHairObj.Id, getPosition(), crossHairObj.MatrixID, ModelMatrix, MVP,
                           ProjectionMatrix, ViewMatrix, true);
-        crossHairObj.draw();
+        crossHairObj.draw(MVP, ModelMatrix);
 
-        ////////////////////////////////////////////////////////////////////////////
-        ////////////////////////      Collider        //////////////////////////////
-        ////////////////////////////////////////////////////////////////////////////
-        for (size_t target_idx = 0; target_idx < targets.size(); ++target_idx) {
-            for (size_t fireball_idx = 0; fireball_idx < fireballs.size(); ++fireball_idx) {
-                if (glm::distance(targets[target_idx].first, fireballs[fireball_idx].position) < Fireball::radius + targetRadius) {
-                    targets.erase(targets.begin() + target_idx);
-                    fireballs.erase(fireballs.begin() + fireball_idx);
-                }
-                if (glm::distance(fireballs[fireball_idx].position, getPosition()) > 2 * maxTargetDistance) {
-                    fireballs.erase(fireballs.begin() + fireball_idx);
+		if (softRasterizer) {
+		    presentSoftFrame();
+		}
+
+		// Swap buffers
+		glfwSwapBuffers(window);
+
+        // The frame that shows a shot is on its way once the GPU is done with it
+        if (!pendingClicks.empty()) {
+            if (measureLatency) {
+                glFinish();
+                const double photonTime = glfwGetTime();
+                for (double clickTime : pendingClicks) {
+                    latencyStats.add((photonTime - clickTime) * 1000.0);
                 }
             }
-            if (glm::distance(targets[target_idx].first, getPosition()) < targetRadius) {
-                std::cout << "You lose!" << std::endl;
-                return 0;
-            }
+            pendingClicks.clear();
         }
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		if (frameTimer.tick(glfwGetTime())) {
+		    break;
+		}
 
 	} // Check if the ESC key was pressed or the window was closed
 	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 );
+	if (measureLatency) {
+	    latencyStats.print();
+	}
+	targets.print();
+	if (dynamicResolution) {
+	    const dynres::Controller& controller = dynamicResolution->getController();
+	    printf("dynamic resolution: gpu %.2f ms on average (target %.2f), final scale %.2f with %dx MSAA, %d changes\n",
+	           controller.getAverage(), controller.getTarget(), controller.getScale(), controller.getSamples(),
+	           controller.getChanges());
+	}
+	if (options.benchFrames > 0) {
+	    frameTimer.print("hw2");
+	    if (!options.benchCsv.empty()) {
+	        frameTimer.writeCsv(options.benchCsv, "hw2", options.params);
+	    }
+	}
+
+	gltrace::end();
+	delete softRasterizer;
+	delete lightGrid;
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
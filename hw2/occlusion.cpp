@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+#include "occlusion.hpp"
+#include "spherebounds.hpp"
+
+namespace occlusion {
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+        : width(width), height(height),
+          blocksX((width + blockSize - 1) / blockSize), blocksY((height + blockSize - 1) / blockSize),
+          depth(size_t(width) * height), blockMaxDepth(size_t(blocksX) * blocksY) {
+}
+
+void OcclusionCuller::begin(const glm::mat4& viewMatrix, const glm::mat4& projection) {
+    view = viewMatrix;
+    scaleX = projection[0][0] * width * 0.5f;
+    scaleY = projection[1][1] * height * 0.5f;
+    // glm::perspective: [2][2] = -(f + n) / (f - n), [3][2] = -2fn / (f - n)
+    nearPlane = projection[3][2] / (projection[2][2] - 1.f);
+    std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::infinity());
+    hierarchyDirty = true;
+    testedCount = 0;
+    occludedCount = 0;
+}
+
+bool OcclusionCuller::project(const glm::vec3& center, Projected& projected) const {
+    const glm::vec4 viewPosition = view * glm::vec4(center, 1.f);
+    projected.depth = -viewPosition.z;
+    if (projected.depth <= 0.f) {
+        return false;
+    }
+    projected.x = viewPosition.x * scaleX / projected.depth + width * 0.5f;
+    projected.y = viewPosition.y * scaleY / projected.depth + height * 0.5f;
+    return true;
+}
+
+void OcclusionCuller::addOccluders(const std::vector<glm::vec4>& spheres, size_t maxOccluders) {
+    std::vector<std::pair<float, size_t>> candidates;
+    candidates.reserve(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        const glm::vec4 viewPosition = view * glm::vec4(glm::vec3(spheres[i]), 1.f);
+        const float nearest = -viewPosition.z - spheres[i].w;
+        // Spheres cut by the near plane would have to be clipped, they are simply skipped
+        if (nearest > nearPlane) {
+            candidates.push_back({nearest, i});
+        }
+    }
+    const size_t count = std::min(maxOccluders, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec4& sphere = spheres[candidates[i].second];
+        Projected center;
+        if (project(glm::vec3(sphere), center)) {
+            rasterizeDisc(center, sphere.w * scaleX / center.depth, sphere.w * scaleY / center.depth);
+        }
+    }
+    hierarchyDirty = true;
+}
+
+void OcclusionCuller::rasterizeDisc(const Projected& center, float radiusX, float radiusY) {
+    const int y0 = std::max(0, int(std::ceil(center.y - radiusY - 0.5f)));
+    const int y1 = std::min(height - 1, int(std::floor(center.y + radiusY - 0.5f)));
+#ifdef OCCLUSION_SSE
+    const __m128 z = _mm_set1_ps(center.depth);
+#endif
+    for (int y = y0; y <= y1; ++y) {
+        // Only pixels whose center is inside the ellipse are written
+        const float dy = (y + 0.5f - center.y) / radiusY;
+        const float halfSpan = radiusX * std::sqrt(std::max(0.f, 1.f - dy * dy));
+        const int x0 = std::max(0, int(std::ceil(center.x - halfSpan - 0.5f)));
+        const int x1 = std::min(width - 1, int(std::floor(center.x + halfSpan - 0.5f)));
+        float* row = &depth[size_t(y) * width];
+        int x = x0;
+#ifdef OCCLUSION_SSE
+        for (; x + 3 <= x1; x += 4) {
+            _mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), z));
+        }
+#endif
+        for (; x <= x1; ++x) {
+            row[x] = std::min(row[x], center.depth);
+        }
+    }
+}
+
+void OcclusionCuller::buildHierarchy() {
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const int x0 = bx * blockSize;
+            const int x1 = std::min(x0 + blockSize, width);
+            const int y1 = std::min((by + 1) * blockSize, height);
+            float farthest = 0.f;
+            for (int y = by * blockSize; y < y1; ++y) {
+                const float* row = &depth[size_t(y) * width];
+                farthest = std::max(farthest, *std::max_element(row + x0, row + x1));
+            }
+            blockMaxDepth[size_t(by) * blocksX + bx] = farthest;
+        }
+    }
+    hierarchyDirty = false;
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3& center, float radius) {
+    ++testedCount;
+    const glm::vec4 viewPosition = view * glm::vec4(center, 1.f);
+    const float centerDepth = -viewPosition.z;
+    const float nearest = centerDepth - radius;
+    if (nearest <= nearPlane) {
+        return true;
+    }
+    if (hierarchyDirty) {
+        buildHierarchy();
+    }
+
+    // Footprint between the tangent lines, which also holds off the view axis
+    float left, right, bottom, top;
+    sphereTangentRange(viewPosition.x, centerDepth, radius, left, right);
+    sphereTangentRange(viewPosition.y, centerDepth, radius, bottom, top);
+    const int x0 = std::max(0, int(std::floor(left * scaleX + width * 0.5f)));
+    const int x1 = std::min(width - 1, int(std::ceil(right * scaleX + width * 0.5f)));
+    const int y0 = std::max(0, int(std::floor(bottom * scaleY + height * 0.5f)));
+    const int y1 = std::min(height - 1, int(std::ceil(top * scaleY + height * 0.5f)));
+    if (x0 > x1 || y0 > y1) {
+        // Off screen, left to the GPU clipper
+        return true;
+    }
+
+#ifdef OCCLUSION_SSE
+    const __m128 z = _mm_set1_ps(nearest);
+#endif
+    for (int by = y0 / blockSize; by <= y1 / blockSize; ++by) {
+        for (int bx = x0 / blockSize; bx <= x1 / blockSize; ++bx) {
+            if (blockMaxDepth[size_t(by) * blocksX + bx] < nearest) {
+                continue;
+            }
+            // Block is not entirely in front, look at the pixels the sphere can touch
+            const int px0 = std::max(x0, bx * blockSize);
+            const int px1 = std::min(x1, bx * blockSize + blockSize - 1);
+            const int py0 = std::max(y0, by * blockSize);
+            const int py1 = std::min(y1, by * blockSize + blockSize - 1);
+            for (int y = py0; y <= py1; ++y) {
+                const float* row = &depth[size_t(y) * width];
+                int x = px0;
+#ifdef OCCLUSION_SSE
+                for (; x + 3 <= px1; x += 4) {
+                    if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z)) != 0) {
+                        return true;
+                    }
+                }
+#endif
+                for (; x <= px1; ++x) {
+                    if (row[x] >= nearest) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    ++occludedCount;
+    return false;
+}
+
+} // namespace occlusion
@@ -0,0 +1,68 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+// Software occlusion culling for sphere-bounded entities.
+//
+// Every frame the nearest occluders are rasterized into a small depth buffer
+// holding linear view depth. Each occluder is written as the disc where the
+// sphere crosses the plane through its center, facing the camera, at the depth
+// of that center. That disc is inside the sphere, so the written depth is never
+// nearer than what the real mesh covers. A max-depth pyramid level over 8x8
+// blocks then lets most queries finish without touching individual pixels.
+// Spans are written and compared four pixels at a time with SSE.
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace occlusion {
+
+class OcclusionCuller {
+public:
+    static constexpr int blockSize = 8;
+
+    OcclusionCuller(int width = 256, int height = 192);
+
+    // Clears the depth buffer and statistics for a new frame
+    void begin(const glm::mat4& view, const glm::mat4& projection);
+
+    // Rasterizes the `maxOccluders` spheres nearest to the camera among
+    // `spheres` (xyz = center, w = radius of a sphere fully inside the mesh).
+    void addOccluders(const std::vector<glm::vec4>& spheres, size_t maxOccluders);
+
+    // Returns false only when the sphere is certainly hidden behind the occluders
+    bool isVisible(const glm::vec3& center, float radius);
+
+    int tested() const { return testedCount; }
+    int occluded() const { return occludedCount; }
+
+private:
+    struct Projected {
+        float x, y;    // center in buffer pixels
+        float depth;   // linear view depth of the center
+    };
+
+    bool project(const glm::vec3& center, Projected& projected) const;
+    void rasterizeDisc(const Projected& center, float radiusX, float radiusY);
+    void buildHierarchy();
+
+    int width;
+    int height;
+    int blocksX;
+    int blocksY;
+    std::vector<float> depth;
+    std::vector<float> blockMaxDepth;
+    bool hierarchyDirty = true;
+
+    glm::mat4 view;
+    float scaleX = 1.f;   // projection[0][0] * width / 2
+    float scaleY = 1.f;   // projection[1][1] * height / 2
+    float nearPlane = 0.1f;
+
+    int testedCount = 0;
+    int occludedCount = 0;
+};
+
+} // namespace occlusion
+
+#endif // OCCLUSION_HPP
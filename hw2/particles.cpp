@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "particles.hpp"
+
+// Attribute indices shared by both programs, bound before linking
+static const GLuint positionAgeIndex = 0;
+static const GLuint velocityLifeIndex = 1;
+
+static GLuint compileShader(GLenum type, const char* path) {
+    std::ifstream stream(path, std::ios::in);
+    if (!stream.is_open()) {
+        fprintf(stderr, "Impossible to open %s.\n", path);
+        return 0;
+    }
+    std::stringstream sstr;
+    sstr << stream.rdbuf();
+    const std::string source = sstr.str();
+    const char* pointer = source.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &pointer, NULL);
+    glCompileShader(shader);
+    GLint result = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+    if (result != GL_TRUE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: %s\n", path, log);
+    }
+    return shader;
+}
+
+// Like LoadShaders, but transform feedback varyings have to be declared before
+// linking and the update program has no fragment shader.
+static GLuint loadParticleProgram(const char* vertexPath, const char* fragmentPath,
+                                  const std::vector<const char*>& feedbackVaryings) {
+    GLuint program = glCreateProgram();
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexPath);
+    GLuint fragmentShader = fragmentPath ? compileShader(GL_FRAGMENT_SHADER, fragmentPath) : 0;
+    glAttachShader(program, vertexShader);
+    if (fragmentShader) {
+        glAttachShader(program, fragmentShader);
+    }
+    glBindAttribLocation(program, positionAgeIndex, "positionAge");
+    glBindAttribLocation(program, velocityLifeIndex, "velocityLife");
+    if (!feedbackVaryings.empty()) {
+        glTransformFeedbackVaryings(program, GLsizei(feedbackVaryings.size()), feedbackVaryings.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+    glLinkProgram(program);
+    GLint result = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "%s: %s\n", vertexPath, log);
+    }
+    glDetachShader(program, vertexShader);
+    glDeleteShader(vertexShader);
+    if (fragmentShader) {
+        glDetachShader(program, fragmentShader);
+        glDeleteShader(fragmentShader);
+    }
+    return program;
+}
+
+bool ParticleSystem::isSupported() {
+    return GLEW_VERSION_3_0;
+}
+
+ParticleSystem::ParticleSystem(size_t capacity) : capacity(capacity) {
+    updateProgram = loadParticleProgram("ParticleUpdateVertexShader.vertexshader", nullptr,
+                                        {"outPositionAge", "outVelocityLife"});
+    deltaTimeID = glGetUniformLocation(updateProgram, "deltaTime");
+    frameID = glGetUniformLocation(updateProgram, "frame");
+    emitterCountID = glGetUniformLocation(updateProgram, "emitterCount");
+    emitterPositionsID = glGetUniformLocation(updateProgram, "emitterPositions");
+    emitterStepsID = glGetUniformLocation(updateProgram, "emitterSteps");
+
+    renderProgram = loadParticleProgram("ParticleVertexShader.vertexshader", "ParticleFragmentShader.fragmentshader", {});
+    viewProjectionID = glGetUniformLocation(renderProgram, "VP");
+    pointScaleID = glGetUniformLocation(renderProgram, "pointScale");
+
+    // Everyone starts dead (life 0) with a random negative age, so births are
+    // spread over the first second instead of happening in one burst
+    std::vector<glm::vec4> initial(capacity * 2);
+    for (size_t i = 0; i < capacity; ++i) {
+        initial[2 * i] = glm::vec4(0.f, 0.f, 0.f, -1.2f * float(std::rand()) / RAND_MAX);
+        initial[2 * i + 1] = glm::vec4(0.f);
+    }
+    glGenBuffers(2, buffers);
+    for (GLuint buffer : buffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, initial.size() * sizeof(glm::vec4), initial.data(), GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    emitterPositions.reserve(maxEmitters);
+    emitterSteps.reserve(maxEmitters);
+
+    // A core profile always rasterizes points as sprites and rejects the enable
+    GLint profile = 0;
+    if (GLEW_VERSION_3_2) {
+        glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    }
+    pointSprites = (profile & GL_CONTEXT_CORE_PROFILE_BIT) == 0;
+}
+
+ParticleSystem::~ParticleSystem() {
+    glDeleteBuffers(2, buffers);
+    glDeleteProgram(updateProgram);
+    glDeleteProgram(renderProgram);
+}
+
+void ParticleSystem::bindState(GLuint buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(positionAgeIndex);
+    glVertexAttribPointer(positionAgeIndex, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+    glEnableVertexAttribArray(velocityLifeIndex);
+    glVertexAttribPointer(velocityLifeIndex, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+}
+
+void ParticleSystem::unbindState() {
+    glDisableVertexAttribArray(positionAgeIndex);
+    glDisableVertexAttribArray(velocityLifeIndex);
+}
+
+void ParticleSystem::update(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& steps,
+                            float deltaTime) {
+    const size_t count = std::min<size_t>(std::min(positions.size(), steps.size()), maxEmitters);
+    const size_t first = positions.size() - count;
+    emitterPositions.clear();
+    emitterSteps.clear();
+    for (size_t i = first; i < first + count; ++i) {
+        emitterPositions.push_back(glm::vec4(positions[i], 1.f));
+        emitterSteps.push_back(glm::vec4(steps[i], 0.f));
+    }
+
+    glUseProgram(updateProgram);
+    glUniform1f(deltaTimeID, deltaTime);
+    glUniform1i(frameID, frame++);
+    glUniform1i(emitterCountID, GLint(count));
+    if (count > 0) {
+        glUniform4fv(emitterPositionsID, GLsizei(count), &emitterPositions[0][0]);
+        glUniform4fv(emitterStepsID, GLsizei(count), &emitterSteps[0][0]);
+    }
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    bindState(buffers[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, GLsizei(capacity));
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    unbindState();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    current = 1 - current;
+}
+
+void ParticleSystem::draw(const glm::mat4& ViewProjection, const glm::mat4& Projection, int viewportHeight) {
+    glUseProgram(renderProgram);
+    glUniformMatrix4fv(viewProjectionID, 1, GL_FALSE, &ViewProjection[0][0]);
+    glUniform1f(pointScaleID, Projection[1][1] * viewportHeight * 0.5f);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    if (pointSprites) {
+        glEnable(GL_POINT_SPRITE); // gl_PointCoord in a compatibility context
+    }
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    bindState(buffers[current]);
+    glDrawArrays(GL_POINTS, 0, GLsizei(capacity));
+    unbindState();
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    if (pointSprites) {
+        glDisable(GL_POINT_SPRITE);
+    }
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
@@ -0,0 +1,62 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+// Fireball trails simulated entirely on the GPU.
+//
+// Particle state lives in two vertex buffers. Every frame a vertex-only pass
+// (ParticleUpdateVertexShader) reads one buffer and writes the other through
+// transform feedback with rasterization disabled: it ages and integrates live
+// particles and respawns dead ones along the last step of a random fireball.
+// The result is drawn as point sprites in a single glDrawArrays. The CPU only
+// uploads the emitters, so its cost does not depend on the particle count.
+//
+// Needs GL 3.0 (transform feedback, GLSL 1.30); see isSupported().
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ParticleSystem {
+public:
+    static constexpr int maxEmitters = 64; // must match ParticleUpdateVertexShader
+
+    static bool isSupported();
+
+    explicit ParticleSystem(size_t capacity);
+    ~ParticleSystem();
+
+    // positions: where the emitters are now, steps: how far they moved during the last frame.
+    // Only the last maxEmitters entries are used.
+    void update(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& steps, float deltaTime);
+
+    // Additive point sprites, depth tested against the scene but not written
+    void draw(const glm::mat4& ViewProjection, const glm::mat4& Projection, int viewportHeight);
+
+    size_t getCapacity() const { return capacity; }
+
+private:
+    void bindState(GLuint buffer);
+    void unbindState();
+
+    size_t capacity;
+    GLuint buffers[2];
+    int current = 0; // buffer holding the latest state
+    int frame = 0;   // seeds the respawn hash
+    bool pointSprites; // GL_POINT_SPRITE only exists in compatibility contexts
+
+    GLuint updateProgram;
+    GLint deltaTimeID;
+    GLint frameID;
+    GLint emitterCountID;
+    GLint emitterPositionsID;
+    GLint emitterStepsID;
+
+    GLuint renderProgram;
+    GLint viewProjectionID;
+    GLint pointScaleID;
+
+    std::vector<glm::vec4> emitterPositions;
+    std::vector<glm::vec4> emitterSteps;
+};
+
+#endif // PARTICLES_HPP
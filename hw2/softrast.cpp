@@ -0,0 +1,644 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTRAST_SSE 1
+#endif
+
+#include "softrast.hpp"
+
+namespace softrast {
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Thread pool     //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned i = 0; i + 1 < threads; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Own queue is used LIFO, victims are robbed FIFO: a thief takes the far end of
+// the victim's range and both keep working on neighbouring tiles
+bool WorkStealingPool::pop(size_t queue, size_t& task) {
+    {
+        Queue& own = *queues[queue];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(queue + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t queue) {
+    size_t task;
+    while (pop(queue, task)) {
+        (*current)(task);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::workerLoop(size_t queue) {
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+        }
+        run(queue);
+    }
+}
+
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = &task;
+        remaining = count;
+        // Contiguous ranges, so the tiles a thread works on are next to each other
+        for (size_t q = 0; q < queues.size(); ++q) {
+            Queue& queue = *queues[q];
+            std::lock_guard<std::mutex> queueLock(queue.mutex);
+            for (size_t i = count * q / queues.size(); i < count * (q + 1) / queues.size(); ++i) {
+                queue.tasks.push_back(i);
+            }
+        }
+        ++generation;
+    }
+    wake.notify_all();
+    run(queues.size() - 1);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+    current = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Texture         //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+static bool readFile(const char* path, std::vector<unsigned char>& data) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "%s could not be opened.\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.resize(size > 0 ? size_t(size) : 0);
+    const bool complete = fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return complete;
+}
+
+static inline uint32_t readU16(const unsigned char* bytes) {
+    return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8);
+}
+
+static inline uint32_t readU32(const unsigned char* bytes) {
+    return readU16(bytes) | (readU16(bytes + 2) << 16);
+}
+
+Texture Texture::loadBMP(const char* path) {
+    Texture texture;
+    std::vector<unsigned char> file;
+    if (!readFile(path, file)) {
+        return texture;
+    }
+    if (file.size() < 54 || file[0] != 'B' || file[1] != 'M' || readU16(&file[0x1C]) != 24) {
+        fprintf(stderr, "%s is not a 24 bit BMP file\n", path);
+        return texture;
+    }
+    const size_t dataPos = readU32(&file[0x0A]) != 0 ? readU32(&file[0x0A]) : 54;
+    const int width = int(readU32(&file[0x12]));
+    const int height = int(readU32(&file[0x16]));
+    // BGR rows padded to 4 bytes, which GL reads the same way with the default GL_UNPACK_ALIGNMENT
+    const size_t stride = (size_t(width) * 3 + 3) & ~size_t(3);
+    if (width <= 0 || height <= 0 || dataPos + stride * height > file.size()) {
+        fprintf(stderr, "%s is truncated\n", path);
+        return texture;
+    }
+
+    texture.width = width;
+    texture.height = height;
+    texture.texels.resize(size_t(width) * height);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* bgr = &file[dataPos + stride * y];
+        for (int x = 0; x < width; ++x, bgr += 3) {
+            texture.texels[size_t(y) * width + x] =
+                uint32_t(bgr[2]) | (uint32_t(bgr[1]) << 8) | (uint32_t(bgr[0]) << 16) | 0xff000000u;
+        }
+    }
+    return texture;
+}
+
+static inline uint32_t expand565(uint32_t color) {
+    const uint32_t r = (color >> 11) & 31;
+    const uint32_t g = (color >> 5) & 63;
+    const uint32_t b = color & 31;
+    return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xff000000u;
+}
+
+// (a * weightA + b * weightB) / divisor on each channel
+static inline uint32_t mixColor(uint32_t a, uint32_t b, uint32_t weightA, uint32_t weightB, uint32_t divisor) {
+    uint32_t mixed = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t channel = (((a >> shift) & 0xff) * weightA + ((b >> shift) & 0xff) * weightB) / divisor;
+        mixed |= channel << shift;
+    }
+    return mixed;
+}
+
+// The 16 texels of a 4x4 color block, row by row. DXT1 blocks whose first
+// endpoint is not greater than the second hold three colors and transparent black.
+static void decodeColorBlock(const unsigned char* block, bool dxt1, uint32_t texels[16]) {
+    const uint32_t color0 = readU16(block);
+    const uint32_t color1 = readU16(block + 2);
+    uint32_t palette[4] = {expand565(color0), expand565(color1)};
+    if (!dxt1 || color0 > color1) {
+        palette[2] = mixColor(palette[0], palette[1], 2, 1, 3);
+        palette[3] = mixColor(palette[0], palette[1], 1, 2, 3);
+    } else {
+        palette[2] = mixColor(palette[0], palette[1], 1, 1, 2);
+        palette[3] = 0;
+    }
+    const uint32_t indices = readU32(block + 4);
+    for (int i = 0; i < 16; ++i) {
+        texels[i] = palette[(indices >> (2 * i)) & 3];
+    }
+}
+
+// DXT3: explicit 4 bit alpha per texel
+static void decodeExplicitAlpha(const unsigned char* block, uint32_t texels[16]) {
+    for (int i = 0; i < 16; ++i) {
+        const uint32_t alpha = (block[i / 2] >> (4 * (i % 2))) & 15;
+        texels[i] = (texels[i] & 0x00ffffffu) | ((alpha * 17) << 24);
+    }
+}
+
+// DXT5: 3 bit indices into eight alphas interpolated from two endpoints
+static void decodeInterpolatedAlpha(const unsigned char* block, uint32_t texels[16]) {
+    const uint32_t alpha0 = block[0];
+    const uint32_t alpha1 = block[1];
+    uint32_t palette[8] = {alpha0, alpha1};
+    if (alpha0 > alpha1) {
+        for (uint32_t i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+        }
+    } else {
+        for (uint32_t i = 1; i < 5; ++i) {
+            palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) {
+        indices |= uint64_t(block[2 + i]) << (8 * i);
+    }
+    for (int i = 0; i < 16; ++i) {
+        texels[i] = (texels[i] & 0x00ffffffu) | (palette[(indices >> (3 * i)) & 7] << 24);
+    }
+}
+
+Texture Texture::loadDDS(const char* path) {
+    Texture texture;
+    std::vector<unsigned char> file;
+    if (!readFile(path, file)) {
+        return texture;
+    }
+    if (file.size() < 128 || memcmp(file.data(), "DDS ", 4) != 0) {
+        fprintf(stderr, "%s is not a DDS file\n", path);
+        return texture;
+    }
+    const int height = int(readU32(&file[12]));
+    const int width = int(readU32(&file[16]));
+    const unsigned char* fourCC = &file[84];
+    int format;
+    if (memcmp(fourCC, "DXT1", 4) == 0) {
+        format = 1;
+    } else if (memcmp(fourCC, "DXT3", 4) == 0) {
+        format = 3;
+    } else if (memcmp(fourCC, "DXT5", 4) == 0) {
+        format = 5;
+    } else {
+        fprintf(stderr, "%s is not DXT1, DXT3 or DXT5 compressed\n", path);
+        return texture;
+    }
+    const size_t blockSize = format == 1 ? 8 : 16;
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    if (width <= 0 || height <= 0 || 128 + blockSize * blocksX * blocksY > file.size()) {
+        fprintf(stderr, "%s is truncated\n", path);
+        return texture;
+    }
+
+    texture.width = width;
+    texture.height = height;
+    texture.texels.resize(size_t(width) * height);
+    const unsigned char* block = &file[128];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx, block += blockSize) {
+            uint32_t texels[16];
+            if (format == 1) {
+                decodeColorBlock(block, true, texels);
+            } else {
+                decodeColorBlock(block + 8, false, texels);
+                if (format == 3) {
+                    decodeExplicitAlpha(block, texels);
+                } else {
+                    decodeInterpolatedAlpha(block, texels);
+                }
+            }
+            // Blocks on the right and top edges of odd sized images are partly outside
+            for (int i = 0; i < 16; ++i) {
+                const int x = bx * 4 + i % 4;
+                const int y = by * 4 + i / 4;
+                if (x < width && y < height) {
+                    texture.texels[size_t(y) * width + x] = texels[i];
+                }
+            }
+        }
+    }
+    return texture;
+}
+
+static inline uint32_t lerpColor(uint32_t a, uint32_t b, uint32_t t) {
+    // t in [0, 256], works on the four channels at once (two per 32 bit lane)
+    const uint32_t rb = ((a & 0x00ff00ffu) * (256 - t) + (b & 0x00ff00ffu) * t) >> 8;
+    const uint32_t ga = (((a >> 8) & 0x00ff00ffu) * (256 - t) + ((b >> 8) & 0x00ff00ffu) * t) >> 8;
+    return (rb & 0x00ff00ffu) | ((ga & 0x00ff00ffu) << 8);
+}
+
+uint32_t Texture::sample(float u, float v) const {
+    if (texels.empty()) {
+        return 0xffffffffu;
+    }
+    const float x = u * width - 0.5f;
+    const float y = v * height - 0.5f;
+    const float fx = std::floor(x);
+    const float fy = std::floor(y);
+    const uint32_t tx = uint32_t((x - fx) * 256.f);
+    const uint32_t ty = uint32_t((y - fy) * 256.f);
+    int x0 = int(fx) % width;
+    int y0 = int(fy) % height;
+    if (x0 < 0) x0 += width;
+    if (y0 < 0) y0 += height;
+    const int x1 = (x0 + 1) % width;
+    const int y1 = (y0 + 1) % height;
+    const uint32_t* row0 = &texels[size_t(y0) * width];
+    const uint32_t* row1 = &texels[size_t(y1) * width];
+    return lerpColor(lerpColor(row0[x0], row0[x1], tx), lerpColor(row1[x0], row1[x1], tx), ty);
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Rasterizer      //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+// Standard 4x rotated grid, relative to the pixel corner
+static const float sampleX[Rasterizer::samples] = {0.375f, 0.875f, 0.125f, 0.625f};
+static const float sampleY[Rasterizer::samples] = {0.125f, 0.375f, 0.625f, 0.875f};
+
+Rasterizer::Rasterizer(int width, int height, unsigned threads)
+        : width(width), height(height),
+          tilesX((width + tileSize - 1) / tileSize), tilesY((height + tileSize - 1) / tileSize),
+          colorSamples(size_t(width) * height * samples), depthSamples(size_t(width) * height * samples, 1.f),
+          resolved(size_t(width) * height), bins(size_t(tilesX) * tilesY), pool(threads) {
+}
+
+static inline uint32_t packColor(const glm::vec4& color) {
+    const auto channel = [](float c) { return uint32_t(std::min(std::max(c, 0.f), 1.f) * 255.f + 0.5f); };
+    return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
+}
+
+void Rasterizer::clear(const glm::vec4& color) {
+    const uint32_t packed = packColor(color);
+    pool.parallelFor(bins.size(), [&](size_t tile) {
+        const int x0 = int(tile % tilesX) * tileSize;
+        const int y0 = int(tile / tilesX) * tileSize;
+        const int x1 = std::min(x0 + tileSize, width);
+        const int y1 = std::min(y0 + tileSize, height);
+        for (int y = y0; y < y1; ++y) {
+            const size_t begin = (size_t(y) * width + x0) * samples;
+            const size_t end = (size_t(y) * width + x1) * samples;
+            std::fill(colorSamples.begin() + begin, colorSamples.begin() + end, packed);
+            std::fill(depthSamples.begin() + begin, depthSamples.begin() + end, 1.f);
+        }
+    });
+}
+
+void Rasterizer::drawTextured(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+                              const glm::mat4& MVP, const Texture* texture) {
+    submit(positions, 0, std::min(positions.size(), uvs.size()), MVP, texture,
+           [&](size_t i) { return glm::vec4(uvs[i], 0.f, 0.f); });
+}
+
+void Rasterizer::drawColored(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& colors,
+                             const glm::mat4& MVP) {
+    submit(positions, 0, std::min(positions.size(), colors.size()), MVP, nullptr,
+           [&](size_t i) { return glm::vec4(colors[i], 1.f); });
+}
+
+void Rasterizer::drawColored(const std::vector<glm::vec3>& positions, size_t first, size_t count,
+                             const glm::mat4& MVP, const glm::vec4& color) {
+    submit(positions, first, count, MVP, nullptr, [&](size_t) { return color; });
+}
+
+template <typename Attribute>
+void Rasterizer::submit(const std::vector<glm::vec3>& positions, size_t first, size_t count, const glm::mat4& MVP,
+                        const Texture* texture, Attribute attribute) {
+    const size_t end = first + std::min(count, positions.size() > first ? positions.size() - first : 0) / 3 * 3;
+    // near (z >= -w) and far (z <= w); x and y are left to the tile bounds
+    const glm::vec4 planes[2] = {glm::vec4(0.f, 0.f, 1.f, 1.f), glm::vec4(0.f, 0.f, -1.f, 1.f)};
+
+    for (size_t i = first; i < end; i += 3) {
+        polygon.clear();
+        bool inside = true;
+        for (size_t k = 0; k < 3; ++k) {
+            ClipVertex vertex = {MVP * glm::vec4(positions[i + k], 1.f), attribute(i + k)};
+            for (const auto& plane : planes) {
+                inside = inside && glm::dot(plane, vertex.position) >= 0.f;
+            }
+            polygon.push_back(vertex);
+        }
+
+        if (!inside) {
+            // Sutherland-Hodgman, a vertex is kept when dot(plane, position) >= 0
+            for (const auto& plane : planes) {
+                clipped.clear();
+                for (size_t k = 0; k < polygon.size(); ++k) {
+                    const ClipVertex& a = polygon[k];
+                    const ClipVertex& b = polygon[(k + 1) % polygon.size()];
+                    const float da = glm::dot(plane, a.position);
+                    const float db = glm::dot(plane, b.position);
+                    if (da >= 0.f) {
+                        clipped.push_back(a);
+                    }
+                    if ((da >= 0.f) != (db >= 0.f)) {
+                        const float t = da / (da - db);
+                        clipped.push_back({a.position + (b.position - a.position) * t,
+                                           a.attribute + (b.attribute - a.attribute) * t});
+                    }
+                }
+                polygon.swap(clipped);
+                if (polygon.size() < 3) {
+                    break;
+                }
+            }
+        }
+
+        for (size_t k = 2; k < polygon.size(); ++k) {
+            setup(polygon[0], polygon[k - 1], polygon[k], texture);
+        }
+    }
+}
+
+void Rasterizer::setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, const Texture* texture) {
+    const ClipVertex* vertices[3] = {&v0, &v1, &v2};
+    float x[3], y[3], z[3], invW[3];
+    glm::vec4 attribute[3];
+    for (int k = 0; k < 3; ++k) {
+        const glm::vec4& p = vertices[k]->position;
+        if (p.w <= 0.f) {
+            return;
+        }
+        invW[k] = 1.f / p.w;
+        x[k] = (p.x * invW[k] * 0.5f + 0.5f) * width;
+        y[k] = (p.y * invW[k] * 0.5f + 0.5f) * height;
+        z[k] = p.z * invW[k] * 0.5f + 0.5f;
+        attribute[k] = vertices[k]->attribute * invW[k];
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0.f || (cullBackFaces && area < 0.f)) {
+        return;
+    }
+    if (area < 0.f) {
+        // Back face with culling disabled: flip the winding so inside stays positive
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        std::swap(invW[1], invW[2]);
+        std::swap(attribute[1], attribute[2]);
+        area = -area;
+    }
+
+    Triangle triangle;
+    triangle.texture = texture;
+    const float minX = std::min(x[0], std::min(x[1], x[2]));
+    const float maxX = std::max(x[0], std::max(x[1], x[2]));
+    const float minY = std::min(y[0], std::min(y[1], y[2]));
+    const float maxY = std::max(y[0], std::max(y[1], y[2]));
+    triangle.minX = std::max(0, int(std::floor(minX)));
+    triangle.minY = std::max(0, int(std::floor(minY)));
+    triangle.maxX = std::min(width - 1, int(std::ceil(maxX)));
+    triangle.maxY = std::min(height - 1, int(std::ceil(maxY)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // Edge k is opposite to vertex k and is positive inside the triangle
+    for (int k = 0; k < 3; ++k) {
+        const int a = (k + 1) % 3;
+        const int b = (k + 2) % 3;
+        triangle.edgeA[k] = y[a] - y[b];
+        triangle.edgeB[k] = x[b] - x[a];
+        triangle.edgeC[k] = -(triangle.edgeA[k] * x[a] + triangle.edgeB[k] * y[a]);
+        triangle.topLeft[k] = triangle.edgeA[k] > 0.f || (triangle.edgeA[k] == 0.f && triangle.edgeB[k] < 0.f);
+    }
+
+    // Anything linear in window space is a blend of the edge functions
+    const float invArea = 1.f / area;
+    const auto plane = [&](float q0, float q1, float q2) {
+        return Plane{(triangle.edgeA[0] * q0 + triangle.edgeA[1] * q1 + triangle.edgeA[2] * q2) * invArea,
+                     (triangle.edgeB[0] * q0 + triangle.edgeB[1] * q1 + triangle.edgeB[2] * q2) * invArea,
+                     (triangle.edgeC[0] * q0 + triangle.edgeC[1] * q1 + triangle.edgeC[2] * q2) * invArea};
+    };
+    triangle.z = plane(z[0], z[1], z[2]);
+    triangle.invW = plane(invW[0], invW[1], invW[2]);
+    for (int k = 0; k < (texture != nullptr ? 2 : 4); ++k) {
+        triangle.attributes[k] = plane(attribute[0][k], attribute[1][k], attribute[2][k]);
+    }
+
+    const uint32_t index = uint32_t(triangles.size());
+    triangles.push_back(triangle);
+    for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty) {
+        for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx) {
+            bins[size_t(ty) * tilesX + tx].push_back(index);
+        }
+    }
+}
+
+const std::vector<uint32_t>& Rasterizer::flush() {
+    pool.parallelFor(bins.size(), [this](size_t tile) {
+        rasterizeTile(tile);
+        resolveTile(tile);
+    });
+    triangles.clear();
+    for (auto& bin : bins) {
+        bin.clear();
+    }
+    return resolved;
+}
+
+void Rasterizer::rasterizeTile(size_t tile) {
+    const int tileX0 = int(tile % tilesX) * tileSize;
+    const int tileY0 = int(tile / tilesX) * tileSize;
+    const int tileX1 = std::min(tileX0 + tileSize, width) - 1;
+    const int tileY1 = std::min(tileY0 + tileSize, height) - 1;
+
+#ifdef SOFTRAST_SSE
+    const __m128 offsetX = _mm_loadu_ps(sampleX);
+    const __m128 offsetY = _mm_loadu_ps(sampleY);
+    const __m128 zero = _mm_setzero_ps();
+#endif
+
+    for (uint32_t index : bins[tile]) {
+        const Triangle& t = triangles[index];
+        const int x0 = std::max(tileX0, t.minX);
+        const int y0 = std::max(tileY0, t.minY);
+        const int x1 = std::min(tileX1, t.maxX);
+        const int y1 = std::min(tileY1, t.maxY);
+
+#ifdef SOFTRAST_SSE
+        __m128 edgeA[3], edgeB[3], edgeC[3], topLeft[3];
+        for (int k = 0; k < 3; ++k) {
+            edgeA[k] = _mm_set1_ps(t.edgeA[k]);
+            edgeB[k] = _mm_set1_ps(t.edgeB[k]);
+            edgeC[k] = _mm_set1_ps(t.edgeC[k]);
+            topLeft[k] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[k] ? -1 : 0));
+        }
+        const __m128 zA = _mm_set1_ps(t.z.a), zB = _mm_set1_ps(t.z.b), zC = _mm_set1_ps(t.z.c);
+        const __m128 always = _mm_castsi128_ps(_mm_set1_epi32(depthTest ? 0 : -1));
+#endif
+
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                const size_t pixel = (size_t(y) * width + x) * samples;
+                float* depth = &depthSamples[pixel];
+                int mask = 0;
+                float sampleDepth[samples];
+
+#ifdef SOFTRAST_SSE
+                const __m128 sx = _mm_add_ps(_mm_set1_ps(float(x)), offsetX);
+                const __m128 sy = _mm_add_ps(_mm_set1_ps(float(y)), offsetY);
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int k = 0; k < 3; ++k) {
+                    const __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[k], sx), _mm_mul_ps(edgeB[k], sy)), edgeC[k]);
+                    const __m128 edgeInside = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(_mm_cmpeq_ps(e, zero), topLeft[k]));
+                    inside = _mm_and_ps(inside, edgeInside);
+                }
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(zA, sx), _mm_mul_ps(zB, sy)), zC);
+                const __m128 passed = _mm_or_ps(_mm_cmplt_ps(z, _mm_loadu_ps(depth)), always);
+                mask = _mm_movemask_ps(_mm_and_ps(inside, passed));
+                _mm_storeu_ps(sampleDepth, z);
+#else
+                for (int s = 0; s < samples; ++s) {
+                    const float sx = x + sampleX[s];
+                    const float sy = y + sampleY[s];
+                    bool covered = true;
+                    for (int k = 0; k < 3; ++k) {
+                        const float e = t.edgeA[k] * sx + t.edgeB[k] * sy + t.edgeC[k];
+                        covered = covered && (e > 0.f || (e == 0.f && t.topLeft[k]));
+                    }
+                    sampleDepth[s] = t.z.at(sx, sy);
+                    if (covered && (!depthTest || sampleDepth[s] < depth[s])) {
+                        mask |= 1 << s;
+                    }
+                }
+#endif
+                if (mask == 0) {
+                    continue;
+                }
+
+                // Shade once per pixel at its center, like GL multisampling does
+                const float cx = x + 0.5f;
+                const float cy = y + 0.5f;
+                const float w = 1.f / t.invW.at(cx, cy);
+                uint32_t color;
+                if (t.texture != nullptr) {
+                    color = t.texture->sample(t.attributes[0].at(cx, cy) * w, t.attributes[1].at(cx, cy) * w);
+                } else {
+                    color = packColor(glm::vec4(t.attributes[0].at(cx, cy), t.attributes[1].at(cx, cy),
+                                                t.attributes[2].at(cx, cy), t.attributes[3].at(cx, cy)) * w);
+                }
+                // Source alpha weighs all four channels, destination alpha included, as in GL
+                const uint32_t alpha = (color >> 24) + (color >> 31);
+
+                uint32_t* colors = &colorSamples[pixel];
+                for (int s = 0; s < samples; ++s) {
+                    if (mask & (1 << s)) {
+                        colors[s] = blend ? lerpColor(colors[s], color, alpha) : color;
+                        depth[s] = sampleDepth[s];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Rasterizer::resolveTile(size_t tile) {
+    const int x0 = int(tile % tilesX) * tileSize;
+    const int y0 = int(tile / tilesX) * tileSize;
+    const int x1 = std::min(x0 + tileSize, width);
+    const int y1 = std::min(y0 + tileSize, height);
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const uint32_t* colors = &colorSamples[(size_t(y) * width + x) * samples];
+            uint32_t rb = 0, ga = 0;
+            for (int s = 0; s < samples; ++s) {
+                rb += colors[s] & 0x00ff00ffu;
+                ga += (colors[s] >> 8) & 0x00ff00ffu;
+            }
+            resolved[size_t(y) * width + x] = ((rb >> 2) & 0x00ff00ffu) | (((ga >> 2) & 0x00ff00ffu) << 8);
+        }
+    }
+}
+
+} // namespace softrast
@@ -0,0 +1,161 @@
+#ifndef SOFTRAST_HPP
+#define SOFTRAST_HPP
+
+// Pure C++ rendering backend that mirrors what the GL path does with
+// TransformVertexShader + TextureFragmentShader and with the color shaders:
+// MVP transform, near/far clipping, perspective-correct interpolation, depth
+// test (GL_LESS), back-face culling (CCW front), alpha blending and 4x MSAA.
+//
+// Rendering itself needs no GL context. hw2, hw1 and hw1_camera with
+// --backend soft still open their GL window and present every frame with
+// glDrawPixels; only softrast_headless runs without GL at all.
+//
+// Draw calls are transformed, clipped and set up on the calling thread, then
+// binned into screen tiles. flush() rasterizes and resolves the tiles on a
+// work-stealing thread pool; coverage and depth of the 4 samples of a pixel
+// are evaluated together with SSE.
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include <glm/glm.hpp>
+
+namespace softrast {
+
+class WorkStealingPool {
+public:
+    // `threads` counts every thread taking part in parallelFor, the caller
+    // included, so threads - 1 workers are started. 0 picks one per core.
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+
+    // Runs task(0) ... task(count - 1) and returns once all of them are done.
+    // The calling thread takes part in the work. Every thread starts on its own
+    // contiguous range of tasks and steals from the others once it runs dry.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    bool pop(size_t queue, size_t& task);
+    void run(size_t queue);
+    void workerLoop(size_t queue);
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, the last one belongs to the caller
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* current = nullptr;
+    std::atomic<size_t> remaining{0};
+    size_t generation = 0;
+    bool stop = false;
+};
+
+// RGBA8 texture sampled with bilinear filtering and GL_REPEAT wrapping.
+struct Texture {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> texels;
+
+    // Level 0 of the same files common/texture.cpp loads, read without GL. Rows
+    // stay in file order, as glTexImage2D receives them, so the backend samples
+    // what the GL path does. A file that cannot be read gives an empty texture,
+    // which samples as white.
+    static Texture loadBMP(const char* path);
+    // DXT1, DXT3 and DXT5 are decompressed
+    static Texture loadDDS(const char* path);
+
+    uint32_t sample(float u, float v) const;
+};
+
+class Rasterizer {
+public:
+    static constexpr int tileSize = 64;
+    static constexpr int samples = 4;
+
+    Rasterizer(int width, int height, unsigned threads = 0);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    void clear(const glm::vec4& color);
+
+    // Equivalent of TransformVertexShader + TextureFragmentShader
+    void drawTextured(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+                      const glm::mat4& MVP, const Texture* texture);
+    // Equivalent of TransformVertexShader + ColorFragmentShader: per vertex colors
+    void drawColored(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& colors,
+                     const glm::mat4& MVP);
+    // Equivalent of hw1's vertex shaders with a fragment shader writing one constant
+    // color, over the vertices [first, first + count) like glDrawArrays
+    void drawColored(const std::vector<glm::vec3>& positions, size_t first, size_t count, const glm::mat4& MVP,
+                     const glm::vec4& color);
+
+    // Rasterizes everything submitted since the last flush and resolves the
+    // samples. The result is RGBA8, bottom row first, as glDrawPixels takes it.
+    const std::vector<uint32_t>& flush();
+
+    bool depthTest = true;
+    bool cullBackFaces = true;
+    // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), as hw1 sets it up
+    bool blend = false;
+
+private:
+    // q(x, y) = a * x + b * y + c over window coordinates
+    struct Plane {
+        float a, b, c;
+        float at(float x, float y) const { return a * x + b * y + c; }
+    };
+
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        bool topLeft[3];
+        Plane z;
+        Plane invW;
+        Plane attributes[4]; // attribute / w, (u, v) when textured, else (r, g, b, a)
+        const Texture* texture;
+        int minX, minY, maxX, maxY;
+    };
+
+    struct ClipVertex {
+        glm::vec4 position;
+        glm::vec4 attribute;
+    };
+
+    template <typename Attribute>
+    void submit(const std::vector<glm::vec3>& positions, size_t first, size_t count, const glm::mat4& MVP,
+                const Texture* texture, Attribute attribute);
+    void setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, const Texture* texture);
+    void rasterizeTile(size_t tile);
+    void resolveTile(size_t tile);
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    std::vector<uint32_t> colorSamples; // samples consecutive values per pixel
+    std::vector<float> depthSamples;
+    std::vector<uint32_t> resolved;
+
+    std::vector<ClipVertex> polygon, clipped; // clipping scratch, kept across draws
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins; // triangle indices per tile, in submission order
+
+    WorkStealingPool pool;
+};
+
+} // namespace softrast
+
+#endif // SOFTRAST_HPP
@@ -0,0 +1,158 @@
+// Headless renderer for the CPU backend of hw2.
+//
+// usage: softrast_headless [--threads N] [--output frame.ppm] [--scene <spec>]
+//                          [--bench-frames N] [--bench-csv <file>]
+//
+// Draws the hw2 scene through softrast::Rasterizer with no window, GL context or
+// display server: textures are decoded straight from the image files and frames
+// never leave memory. Every frame is hashed (FNV-1a) so runs can be compared
+// across thread counts and machines, --output writes the last frame as a binary
+// PPM. The scene is generated by scenegen with hw2's defaults and drawn from
+// hw2's starting camera, its projectiles move at a fixed 1/60 s per frame.
+// --threads counts every rasterizing thread, the main one included, 0 = one per core.
+// Run it from the hw2 directory, like hw2, so images/ and objects/ are found.
+
+// Include standard headers
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <cmath>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/objloader.hpp>
+
+#include "softrast.hpp"
+#include "../scenegen/scenegen.hpp"
+
+struct Model {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    softrast::Texture texture;
+};
+
+// Folds one frame into a running FNV-1a hash
+uint64_t hashFrame(uint64_t hash, const std::vector<uint32_t>& pixels) {
+    for (uint32_t pixel : pixels) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((pixel >> shift) & 0xff)) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+// The rasterizer keeps the bottom row first, PPM wants the top one first
+bool writePPM(const char* path, const std::vector<uint32_t>& pixels, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Impossible to open %s\n", path);
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x) {
+            const uint32_t pixel = pixels[size_t(y) * width + x];
+            row[3 * x] = pixel & 0xff;
+            row[3 * x + 1] = (pixel >> 8) & 0xff;
+            row[3 * x + 2] = (pixel >> 16) & 0xff;
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Same scene defaults as hw2
+    scenegen::Options options;
+    options.params.innerRadius = 5.f;
+    options.params.extent = 30.f;
+    if (!scenegen::parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    unsigned threads = 0;
+    const char* outputPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = unsigned(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+    }
+    const int frames = options.benchFrames > 0 ? options.benchFrames : 120;
+
+    softrast::Rasterizer rasterizer(1024, 768, threads);
+
+    // Same assets as hw2 with a generated scene: materials cycle through its images
+    scenegen::Scene scene = scenegen::generate(options.params);
+    const std::pair<const char*, bool> images[] = {
+        {"images/earthmap.bmp", false}, {"images/virus.bmp", false},
+        {"images/uvtemplate.DDS", true}, {"images/fire.DDS", true}, {"images/target.DDS", true}
+    };
+    std::vector<softrast::Texture> materials;
+    for (int material = 0; material < scene.params.materials; ++material) {
+        const auto& image = images[material % (sizeof(images) / sizeof(images[0]))];
+        materials.push_back(image.second ? softrast::Texture::loadDDS(image.first)
+                                         : softrast::Texture::loadBMP(image.first));
+    }
+    Model fireball, crossHair;
+    std::vector<glm::vec3> normals;
+    if (!loadOBJ("objects/fireball.obj", fireball.vertices, fireball.uvs, normals) ||
+        !loadOBJ("objects/crosshair.obj", crossHair.vertices, crossHair.uvs, normals)) {
+        return 1;
+    }
+    fireball.texture = softrast::Texture::loadBMP("images/virus.bmp");
+    crossHair.texture = softrast::Texture::loadDDS("images/new_target.DDS");
+
+    // hw2's starting camera (common/controls.cpp): at (0, 0, 5) looking down -z
+    const float horizontalAngle = 3.14f;
+    const glm::vec3 position(0.f, 0.f, 5.f);
+    const glm::vec3 direction(std::sin(horizontalAngle), 0.f, std::cos(horizontalAngle));
+    const glm::vec3 right(std::sin(horizontalAngle - 3.14f / 2.f), 0.f, std::cos(horizontalAngle - 3.14f / 2.f));
+    const glm::mat4 ProjectionMatrix = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+    const glm::mat4 ViewMatrix = glm::lookAt(position, position + direction, glm::cross(right, direction));
+    const glm::mat4 VP = ProjectionMatrix * ViewMatrix;
+
+    using clock = std::chrono::steady_clock;
+    scenegen::FrameTimer frameTimer(frames);
+    const auto start = clock::now();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    int rendered = 0;
+    for (;;) {
+        rasterizer.clear(glm::vec4(0.4f, 0.5f, 1.f, 0.0f));
+        for (const auto& sphere : scene.spheres) {
+            rasterizer.drawTextured(scene.sphere.vertices, scene.sphere.uvs,
+                                    VP * glm::translate(glm::mat4(1.f), sphere.position), &materials[sphere.material]);
+        }
+        for (const auto& projectile : scene.projectiles) {
+            rasterizer.drawTextured(fireball.vertices, fireball.uvs,
+                                    VP * glm::translate(glm::mat4(1.f), projectile.position), &fireball.texture);
+        }
+        // hw2 draws the crosshair straight in clip space
+        rasterizer.drawTextured(crossHair.vertices, crossHair.uvs, glm::mat4(0.7f), &crossHair.texture);
+        const std::vector<uint32_t>& pixels = rasterizer.flush();
+        hash = hashFrame(hash, pixels);
+        ++rendered;
+
+        scenegen::advance(scene, 1.f / 60.f);
+        if (frameTimer.tick(std::chrono::duration<double>(clock::now() - start).count())) {
+            if (outputPath != nullptr && !writePPM(outputPath, pixels, rasterizer.getWidth(), rasterizer.getHeight())) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    frameTimer.print("softrast_headless");
+    if (!options.benchCsv.empty()) {
+        frameTimer.writeCsv(options.benchCsv, "softrast_headless", options.params);
+    }
+    printf("frames rendered: %d, hash %016llx\n", rendered, (unsigned long long)hash);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef SPHEREBOUNDS_HPP
+#define SPHEREBOUNDS_HPP
+
+// Screen extent of a sphere under a perspective projection.
+//
+// Along each screen axis a sphere covers the angle between the two lines
+// through the eye that are tangent to it. Dividing center +- radius by a
+// single depth is only right on the view axis: off axis the projected sphere
+// is stretched and pushed outwards, so such a rectangle misses part of it.
+
+#include <cmath>
+
+// Range of lateral / depth covered by a sphere along one view-space axis.
+// `lateral` is the center's coordinate along that axis and `depth` its distance
+// in front of the eye. The sphere must be entirely in front (depth > radius).
+// Multiplied by projection[0][0] (x) or projection[1][1] (y) this gives NDC.
+inline void sphereTangentRange(float lateral, float depth, float radius, float& low, float& high) {
+    const float tangent = std::sqrt(lateral * lateral + depth * depth - radius * radius);
+    low = (lateral * tangent - radius * depth) / (depth * tangent + radius * lateral);
+    high = (lateral * tangent + radius * depth) / (depth * tangent - radius * lateral);
+}
+
+#endif // SPHEREBOUNDS_HPP
@@ -0,0 +1,104 @@
+#ifndef TARGETPOOL_HPP
+#define TARGETPOOL_HPP
+
+// Bounded storage for the live targets of hw2.
+//
+// All slots are allocated up front and the live targets are kept packed at
+// the front, so spawning, hitting and retiring never allocate and iterating
+// only touches live targets. A target leaves the pool when it is hit, when
+// it is retired for being too far from the player (or behind and far enough),
+// or when a spawn finds the pool full and evicts the farthest target.
+
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+struct Target {
+    glm::vec3 position;
+    size_t id; // stable for the target's lifetime, picks its material
+};
+
+class TargetPool {
+public:
+    struct Metrics {
+        size_t live = 0;
+        size_t peak = 0;
+        size_t spawned = 0;
+        size_t hit = 0;
+        size_t retired = 0;
+        size_t evicted = 0;
+    };
+
+    // retireDistance: targets farther than this are retired wherever they are
+    // retireBehindDistance: targets behind the player are retired past this distance
+    TargetPool(size_t capacity, float retireDistance, float retireBehindDistance)
+            : slots(capacity > 0 ? capacity : 1), retireDistance(retireDistance),
+              retireBehindDistance(retireBehindDistance) {}
+
+    // At capacity the target farthest from `viewer` makes room for the new one
+    size_t spawn(const glm::vec3& position, const glm::vec3& viewer) {
+        if (stats.live == slots.size()) {
+            size_t farthest = 0;
+            for (size_t i = 1; i < stats.live; ++i) {
+                if (glm::distance(slots[i].position, viewer) > glm::distance(slots[farthest].position, viewer)) {
+                    farthest = i;
+                }
+            }
+            remove(farthest);
+            ++stats.evicted;
+        }
+        slots[stats.live++] = {position, nextId++};
+        ++stats.spawned;
+        stats.peak = std::max(stats.peak, stats.live);
+        return slots[stats.live - 1].id;
+    }
+
+    // The last live target moves into `index`, which then has to be visited again
+    void hit(size_t index) {
+        remove(index);
+        ++stats.hit;
+    }
+
+    void retire(const glm::vec3& viewer, const glm::vec3& direction) {
+        for (size_t i = 0; i < stats.live;) {
+            const glm::vec3 offset = slots[i].position - viewer;
+            const float distance = glm::length(offset);
+            const bool behind = glm::dot(offset, direction) < 0.f;
+            if (distance > retireDistance || (behind && distance > retireBehindDistance)) {
+                remove(i);
+                ++stats.retired;
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    size_t size() const { return stats.live; }
+    bool empty() const { return stats.live == 0; }
+    size_t capacity() const { return slots.size(); }
+    const Target& operator[](size_t index) const { return slots[index]; }
+    const Target* begin() const { return slots.data(); }
+    const Target* end() const { return slots.data() + stats.live; }
+
+    const Metrics& metrics() const { return stats; }
+
+    void print() const {
+        printf("targets: live %zu, peak %zu / %zu, spawned %zu, hit %zu, retired %zu, evicted %zu\n", stats.live,
+               stats.peak, slots.size(), stats.spawned, stats.hit, stats.retired, stats.evicted);
+    }
+
+private:
+    void remove(size_t index) {
+        slots[index] = slots[--stats.live];
+    }
+
+    std::vector<Target> slots;
+    float retireDistance;
+    float retireBehindDistance;
+    size_t nextId = 0;
+    Metrics stats;
+};
+
+#endif // TARGETPOOL_HPP
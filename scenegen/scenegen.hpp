@@ -0,0 +1,396 @@
+#ifndef SCENEGEN_HPP
+#define SCENEGEN_HPP
+
+// Procedural stress scenes shared by all demos.
+//
+// A scene is described by a spec string such as
+//     spheres=500,tess=32,projectiles=200,materials=8,dist=clustered,seed=3
+// and passed to a demo with --scene <spec>. --bench-frames <n> makes the demo
+// exit after n measured frames and --bench-csv <file> appends the frame time
+// percentiles to a CSV (see sweep.sh).
+//
+// Keys: spheres, tess, projectiles, materials, dist (uniform|shell|clustered|grid),
+//       extent (half size of the populated cube), inner (no sphere closer to the
+//       origin than this), radius, seed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace scenegen {
+
+enum class Distribution { Uniform, Shell, Clustered, Grid };
+
+struct SceneParams {
+    int spheres = 100;
+    int tessellation = 16;
+    int projectiles = 0;
+    int materials = 2;
+    Distribution distribution = Distribution::Uniform;
+    float extent = 30.f;
+    float innerRadius = 0.f;
+    float radius = 1.f;
+    unsigned seed = 1;
+};
+
+inline const char* distributionName(Distribution distribution) {
+    switch (distribution) {
+        case Distribution::Shell: return "shell";
+        case Distribution::Clustered: return "clustered";
+        case Distribution::Grid: return "grid";
+        default: return "uniform";
+    }
+}
+
+// Parses "key=value,key=value". Unknown keys are reported and make the call fail.
+inline bool parseParams(const char* spec, SceneParams& params) {
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            fprintf(stderr, "Bad scene parameter '%s'\n", item.c_str());
+            return false;
+        }
+        const std::string key = item.substr(0, eq);
+        const char* value = item.c_str() + eq + 1;
+        if (key == "spheres") {
+            params.spheres = std::max(0, atoi(value));
+        } else if (key == "tess") {
+            params.tessellation = std::max(3, atoi(value));
+        } else if (key == "projectiles") {
+            params.projectiles = std::max(0, atoi(value));
+        } else if (key == "materials") {
+            params.materials = std::max(1, atoi(value));
+        } else if (key == "extent") {
+            params.extent = float(atof(value));
+        } else if (key == "inner") {
+            params.innerRadius = float(atof(value));
+        } else if (key == "radius") {
+            params.radius = float(atof(value));
+        } else if (key == "seed") {
+            params.seed = unsigned(strtoul(value, NULL, 10));
+        } else if (key == "dist") {
+            const std::string name(value);
+            if (name == "uniform") {
+                params.distribution = Distribution::Uniform;
+            } else if (name == "shell") {
+                params.distribution = Distribution::Shell;
+            } else if (name == "clustered") {
+                params.distribution = Distribution::Clustered;
+            } else if (name == "grid") {
+                params.distribution = Distribution::Grid;
+            } else {
+                fprintf(stderr, "Unknown distribution '%s'\n", value);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Unknown scene parameter '%s'\n", key.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Non indexed triangle soup, laid out like the output of loadOBJ
+struct Mesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+};
+
+// UV sphere with `tessellation` rings and 2 * `tessellation` segments, CCW seen from outside
+inline Mesh makeSphere(int tessellation, float radius) {
+    Mesh mesh;
+    const int rings = std::max(3, tessellation);
+    const int segments = 2 * rings;
+    const float pi = 3.14159265358979f;
+    auto point = [&](int ring, int segment, glm::vec3& normal, glm::vec2& uv) {
+        const float theta = pi * ring / rings;
+        const float phi = 2.f * pi * segment / segments;
+        normal = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+        uv = glm::vec2(float(segment) / segments, float(ring) / rings);
+    };
+    for (int ring = 0; ring < rings; ++ring) {
+        for (int segment = 0; segment < segments; ++segment) {
+            glm::vec3 n[4];
+            glm::vec2 t[4];
+            point(ring, segment, n[0], t[0]);
+            point(ring + 1, segment, n[1], t[1]);
+            point(ring + 1, segment + 1, n[2], t[2]);
+            point(ring, segment + 1, n[3], t[3]);
+            const int quads[2][3] = {{0, 1, 2}, {0, 2, 3}};
+            for (int q = 0; q < 2; ++q) {
+                // Skip the degenerate half of the quads touching a pole
+                if ((ring == 0 && q == 1) || (ring == rings - 1 && q == 0)) {
+                    continue;
+                }
+                for (int k : quads[q]) {
+                    mesh.vertices.push_back(n[k] * radius);
+                    mesh.normals.push_back(n[k]);
+                    mesh.uvs.push_back(t[k]);
+                }
+            }
+        }
+    }
+    return mesh;
+}
+
+struct Instance {
+    glm::vec3 position;
+    glm::vec3 velocity;
+    int material;
+};
+
+struct Scene {
+    SceneParams params;
+    Mesh sphere;
+    Mesh projectile;
+    std::vector<Instance> spheres;
+    std::vector<Instance> projectiles;
+    std::vector<glm::vec3> materialColors;
+};
+
+inline Scene generate(const SceneParams& params) {
+    Scene scene;
+    scene.params = params;
+    scene.sphere = makeSphere(params.tessellation, params.radius);
+    scene.projectile = makeSphere(std::max(3, params.tessellation / 2), params.radius * 0.3f);
+
+    std::mt19937 random(params.seed);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::normal_distribution<float> gauss(0.f, 1.f);
+    const float extent = params.extent;
+
+    auto direction = [&]() {
+        glm::vec3 d(gauss(random), gauss(random), gauss(random));
+        const float length = glm::length(d);
+        return length > 0.f ? d / length : glm::vec3(0.f, 0.f, 1.f);
+    };
+
+    std::vector<glm::vec3> clusters;
+    if (params.distribution == Distribution::Clustered) {
+        const int count = std::max(1, params.spheres / 50);
+        for (int i = 0; i < count; ++i) {
+            clusters.push_back(glm::vec3(unit(random), unit(random), unit(random)) * (extent * 0.8f));
+        }
+    }
+    const int gridSide = std::max(1, int(std::ceil(std::cbrt(double(params.spheres)))));
+
+    for (int i = 0; i < params.spheres; ++i) {
+        glm::vec3 position;
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            switch (params.distribution) {
+                case Distribution::Shell:
+                    position = direction() * extent;
+                    break;
+                case Distribution::Clustered:
+                    position = clusters[random() % clusters.size()] + direction() * (extent * 0.1f * std::fabs(gauss(random)));
+                    break;
+                case Distribution::Grid: {
+                    const float step = gridSide > 1 ? 2.f * extent / (gridSide - 1) : 0.f;
+                    position = glm::vec3(i % gridSide, (i / gridSide) % gridSide, i / (gridSide * gridSide)) * step
+                               - glm::vec3(extent);
+                    break;
+                }
+                default:
+                    position = glm::vec3(unit(random), unit(random), unit(random)) * extent;
+                    break;
+            }
+            if (glm::length(position) >= params.innerRadius || params.distribution == Distribution::Grid) {
+                break;
+            }
+        }
+        if (glm::length(position) < params.innerRadius && params.distribution != Distribution::Grid) {
+            position = direction() * params.innerRadius;
+        }
+        scene.spheres.push_back({position, glm::vec3(0.f), i % params.materials});
+    }
+
+    for (int i = 0; i < params.projectiles; ++i) {
+        const glm::vec3 position = glm::vec3(unit(random), unit(random), unit(random)) * extent;
+        scene.projectiles.push_back({position, direction() * (extent * 0.25f), i % params.materials});
+    }
+
+    for (int i = 0; i < params.materials; ++i) {
+        // Spread hues around the color wheel
+        const float hue = 6.f * i / params.materials;
+        const float x = 1.f - std::fabs(std::fmod(hue, 2.f) - 1.f);
+        const int sector = int(hue);
+        glm::vec3 color = sector == 0 ? glm::vec3(1, x, 0) : sector == 1 ? glm::vec3(x, 1, 0)
+                        : sector == 2 ? glm::vec3(0, 1, x) : sector == 3 ? glm::vec3(0, x, 1)
+                        : sector == 4 ? glm::vec3(x, 0, 1) : glm::vec3(1, 0, x);
+        scene.materialColors.push_back(color);
+    }
+    return scene;
+}
+
+// Moves projectiles along their velocity, wrapping them around the populated cube
+inline void advance(Scene& scene, float deltaTime) {
+    const float extent = scene.params.extent;
+    for (auto& projectile : scene.projectiles) {
+        projectile.position += projectile.velocity * deltaTime;
+        for (int k = 0; k < 3; ++k) {
+            if (projectile.position[k] > extent) projectile.position[k] -= 2.f * extent;
+            if (projectile.position[k] < -extent) projectile.position[k] += 2.f * extent;
+        }
+    }
+}
+
+// Range of a flattened buffer that shares one material
+struct Batch {
+    int material;
+    size_t first;
+    size_t count;
+};
+
+// Bakes instances into world space triangles grouped by material, for demos
+// that draw plain position/color buffers. Positions are multiplied by `scale`
+// so the scene fits the view of the demo. The output vectors are cleared and
+// refilled, so passing the same ones every frame reuses their storage.
+inline void flatten(const Scene& scene, const Mesh& mesh, const std::vector<Instance>& instances, float scale,
+                    std::vector<glm::vec3>& positions, std::vector<glm::vec3>& colors, std::vector<Batch>& batches) {
+    batches.clear();
+    positions.clear();
+    colors.clear();
+    for (int material = 0; material < scene.params.materials; ++material) {
+        Batch batch = {material, positions.size(), 0};
+        for (const auto& instance : instances) {
+            if (instance.material != material) {
+                continue;
+            }
+            for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+                positions.push_back((instance.position + mesh.vertices[v]) * scale);
+                // Shade by the normal a little so spheres do not look flat
+                colors.push_back(scene.materialColors[material] * (0.6f + 0.4f * std::fabs(mesh.normals[v].y)));
+            }
+        }
+        batch.count = positions.size() - batch.first;
+        if (batch.count > 0) {
+            batches.push_back(batch);
+        }
+    }
+}
+
+inline std::vector<Batch> flatten(const Scene& scene, const Mesh& mesh, const std::vector<Instance>& instances,
+                                  float scale, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& colors) {
+    std::vector<Batch> batches;
+    flatten(scene, mesh, instances, scale, positions, colors, batches);
+    return batches;
+}
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////      Benchmark       //////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+struct Options {
+    bool hasScene = false;
+    SceneParams params;
+    int benchFrames = 0;
+    std::string benchCsv;
+};
+
+// Picks --scene, --bench-frames and --bench-csv out of the command line and
+// leaves every other argument to the demo. Returns false on a malformed spec.
+inline bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            options.hasScene = true;
+            if (!parseParams(argv[++i], options.params)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+            options.benchFrames = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-csv") == 0 && i + 1 < argc) {
+            options.benchCsv = argv[++i];
+        }
+    }
+    return true;
+}
+
+// Nearest rank: the smallest sample that at least a fraction p of the samples do not exceed
+inline double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t rank = size_t(std::ceil(p * values.size()));
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+class FrameTimer {
+public:
+    // Frames skipped before recording, they include shader compilation and first uploads
+    static constexpr int warmupFrames = 10;
+
+    explicit FrameTimer(int frames) : frames(frames) {
+        samples.reserve(frames);
+    }
+
+    // Call once per frame with the current time in seconds. Returns true once
+    // the requested number of frames has been measured.
+    bool tick(double now) {
+        if (seen++ >= warmupFrames) {
+            samples.push_back((now - last) * 1000.0);
+        }
+        last = now;
+        return frames > 0 && int(samples.size()) >= frames;
+    }
+
+    double percentile(double p) const {
+        return scenegen::percentile(samples, p);
+    }
+
+    double mean() const {
+        double sum = 0.0;
+        for (double sample : samples) {
+            sum += sample;
+        }
+        return samples.empty() ? 0.0 : sum / samples.size();
+    }
+
+    // Appends one row, writing the header first if the file is new
+    void writeCsv(const std::string& path, const char* demo, const SceneParams& params) const {
+        FILE* existing = fopen(path.c_str(), "r");
+        const bool fresh = existing == NULL;
+        if (existing) {
+            fclose(existing);
+        }
+        FILE* file = fopen(path.c_str(), "a");
+        if (file == NULL) {
+            fprintf(stderr, "Impossible to open %s\n", path.c_str());
+            return;
+        }
+        if (fresh) {
+            fprintf(file, "demo,spheres,tess,projectiles,materials,dist,seed,frames,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+        }
+        fprintf(file, "%s,%d,%d,%d,%d,%s,%u,%zu,%.3f,%.3f,%.3f,%.3f,%.3f\n", demo, params.spheres,
+                params.tessellation, params.projectiles, params.materials, distributionName(params.distribution),
+                params.seed, samples.size(), mean(), percentile(0.5), percentile(0.9), percentile(0.99),
+                percentile(1.0));
+        fclose(file);
+    }
+
+    void print(const char* demo) const {
+        printf("%s: %zu frames, mean %.3f ms, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", demo, samples.size(),
+               mean(), percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+    }
+
+private:
+    int frames;
+    int seen = 0;
+    double last = 0.0;
+    std::vector<double> samples;
+};
+
+} // namespace scenegen
+
+#endif // SCENEGEN_HPP
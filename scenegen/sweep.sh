@@ -0,0 +1,55 @@
+#!/bin/sh
+# Runs every demo over a grid of generated scenes and collects frame time
+# percentiles into one CSV (one row per demo and parameter set).
+#
+# usage: scenegen/sweep.sh [out.csv]
+#
+# Binaries are looked up next to their sources and can be overridden:
+#   HW1_BIN, HW1_CAMERA_BIN, HW1_TETRAHEDRON_BIN, HW2_BIN
+# The grid can be narrowed with SPHERES, TESS, PROJECTILES, MATERIALS, DISTS
+# (space separated lists) and FRAMES (measured frames per run).
+
+set -u
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${1:-$ROOT/sweep.csv}
+case "$OUT" in
+    /*) ;;
+    *) OUT=$(pwd)/$OUT ;;
+esac
+
+FRAMES=${FRAMES:-300}
+SPHERES=${SPHERES:-"10 100 1000 5000"}
+TESS=${TESS:-"8 16 32"}
+PROJECTILES=${PROJECTILES:-"0 100 1000"}
+MATERIALS=${MATERIALS:-"1 8"}
+DISTS=${DISTS:-"uniform clustered"}
+
+# demo name, directory (shaders are loaded relative to it), binary
+DEMOS="hw1:hw1:${HW1_BIN:-$ROOT/hw1/hw1}
+hw1_camera:hw1_camera:${HW1_CAMERA_BIN:-$ROOT/hw1_camera/hw1_camera}
+hw1_tetrahedron:hw1_tetrahedron:${HW1_TETRAHEDRON_BIN:-$ROOT/hw1_tetrahedron/hw1_tetrahedron}
+hw2:hw2:${HW2_BIN:-$ROOT/hw2/tutorial06_keyboard_and_mouse}"
+
+echo "$DEMOS" | while IFS=: read -r name dir bin; do
+    if [ ! -x "$bin" ]; then
+        echo "skipping $name: $bin not found" >&2
+        continue
+    fi
+    for spheres in $SPHERES; do
+    for tess in $TESS; do
+    for projectiles in $PROJECTILES; do
+    for materials in $MATERIALS; do
+    for dist in $DISTS; do
+        spec="spheres=$spheres,tess=$tess,projectiles=$projectiles,materials=$materials,dist=$dist"
+        echo "$name $spec"
+        (cd "$ROOT/$dir" && "$bin" --scene "$spec" --bench-frames "$FRAMES" --bench-csv "$OUT") ||
+            echo "$name failed on $spec" >&2
+    done
+    done
+    done
+    done
+    done
+done
+
+echo "results in $OUT"